@@ -0,0 +1,435 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __ASYNC_HPP__
+#define __ASYNC_HPP__
+
+#include "sqlite.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define SQLITEPP_HAS_COROUTINES 1
+#endif
+#endif
+
+namespace sqlite {
+
+namespace detail {
+
+	/*
+	 * Vyukov's intrusive multi-producer/single-consumer queue: push() is
+	 * one atomic exchange, pop() is only ever called by the consumer.
+	 */
+	struct mpsc_node {
+		std::atomic<mpsc_node*> next{nullptr};
+	};
+
+	struct mpsc_queue {
+
+		mpsc_queue() : m_head(&m_stub), m_tail(&m_stub) {}
+
+		mpsc_queue(const mpsc_queue&) = delete;
+		mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+		// the exchange is seq_cst, so that a producer's later seq_cst load is ordered after it
+		void push(mpsc_node* n) noexcept {
+			n->next.store(nullptr, std::memory_order_relaxed);
+			const auto prev = m_head.exchange(n, std::memory_order_seq_cst);
+			prev->next.store(n, std::memory_order_release);
+		}
+
+		// nullptr when empty or while a push is half done
+		mpsc_node* pop() noexcept {
+			auto tail = m_tail;
+			auto next = tail->next.load(std::memory_order_acquire);
+			if (tail == &m_stub) {
+				if (next == nullptr) {
+					return nullptr;
+				}
+				m_tail = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+			if (next != nullptr) {
+				m_tail = next;
+				return tail;
+			}
+			if (tail != m_head.load(std::memory_order_acquire)) {
+				return nullptr;
+			}
+			push(&m_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next != nullptr) {
+				m_tail = next;
+				return tail;
+			}
+			return nullptr;
+		}
+
+		// consumer side only; seq_cst to pair with push(), see async_connection::enqueue()
+		bool empty() const noexcept {
+			return m_tail->next.load(std::memory_order_seq_cst) == nullptr
+			       && m_head.load(std::memory_order_seq_cst) == m_tail;
+		}
+
+		private:
+		std::atomic<mpsc_node*> m_head;
+		mpsc_node* m_tail;
+		mpsc_node m_stub;
+	};
+
+	struct async_task : mpsc_node {
+		bool write = false;
+		std::exception_ptr error;
+		std::function<void()> on_done;
+
+		virtual ~async_task() {}
+		// runs the query, keeping the outcome until publish()
+		virtual void run(connection& c) noexcept = 0;
+		virtual void publish(std::exception_ptr batch_error) = 0;
+
+		inline bool failed() const noexcept { return error != nullptr; }
+	};
+
+	template<typename R>
+	struct async_value {
+		std::unique_ptr<R> value;
+
+		template<typename F>
+		void compute(F& f, connection& c) { value.reset(new R(f(c))); }
+
+		void fulfil(std::promise<R>& p) { p.set_value(std::move(*value)); }
+	};
+
+	template<>
+	struct async_value<void> {
+		template<typename F>
+		void compute(F& f, connection& c) { f(c); }
+
+		void fulfil(std::promise<void>& p) { p.set_value(); }
+	};
+
+	template<typename F>
+	struct async_result {
+		using type = typename std::decay<decltype(std::declval<F&>()(std::declval<connection&>()))>::type;
+	};
+
+	template<typename R, typename F>
+	struct async_task_impl : async_task {
+		F fn;
+		std::promise<R> promise;
+		async_value<R> result;
+
+		explicit async_task_impl(F f) : fn(std::move(f)) {}
+
+		void run(connection& c) noexcept override {
+			try {
+				result.compute(fn, c);
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+
+		void publish(std::exception_ptr batch_error) override {
+			if (error != nullptr) {
+				promise.set_exception(error);
+			} else if (batch_error != nullptr) {
+				promise.set_exception(batch_error);
+			} else {
+				result.fulfil(promise);
+			}
+		}
+	};
+
+} /* namespace detail */
+
+/*
+ * Owns a connection on its own thread; queries are functions of
+ * connection& that are queued from any thread and answered through
+ * std::future (or co_await in C++20 builds).
+ *
+ * Writes that are queued back to back run in one BEGIN IMMEDIATE ...
+ * COMMIT of up to max_batch writes, each inside its own savepoint, so a
+ * failing write is rolled back alone. Their futures only become ready
+ * after the COMMIT; if the COMMIT fails, they all get its error. Some
+ * errors make SQLite roll back the whole transaction instead (ON CONFLICT
+ * ROLLBACK, SQLITE_FULL, I/O errors): the failing write gets its error,
+ * the writes before it in the transaction get sql_error(SQLITE_ABORT),
+ * and the rest of the batch goes on in a new transaction. Writes must
+ * therefore not BEGIN/COMMIT themselves, but may use savepoints.
+ * Reads run outside of any transaction, in queue order with the writes.
+ *
+ * The destructor finishes everything already queued before it returns.
+ */
+struct async_connection {
+
+	using factory = std::function<connection()>;
+
+	explicit async_connection(factory open, std::size_t max_batch = 256)
+	: m_max_batch(max_batch == 0 ? 1 : max_batch) {
+		auto ready = std::make_shared<std::promise<void>>();
+		auto opened = ready->get_future();
+		m_worker = std::thread([this, open, ready] {
+			try {
+				m_conn = open();
+			} catch (...) {
+				ready->set_exception(std::current_exception());
+				return;
+			}
+			ready->set_value();
+			work();
+		});
+		try {
+			opened.get();
+		} catch (...) {
+			m_worker.join();
+			throw;
+		}
+	}
+
+	async_connection(const async_connection&) = delete;
+	async_connection& operator=(const async_connection&) = delete;
+
+	~async_connection() {
+		m_stop.store(true);
+		wake();
+		m_worker.join();
+	}
+
+	template<typename F>
+	auto read(F f) -> std::future<typename detail::async_result<F>::type> {
+		return submit(std::move(f), false);
+	}
+
+	template<typename F>
+	auto write(F f) -> std::future<typename detail::async_result<F>::type> {
+		return submit(std::move(f), true);
+	}
+
+	inline std::size_t batches_committed() const noexcept { return m_batches.load(); }
+	inline std::size_t writes_committed() const noexcept { return m_writes.load(); }
+
+#ifdef SQLITEPP_HAS_COROUTINES
+	/*
+	 * co_await db.co_read(f) / db.co_write(f). The coroutine continues on
+	 * the database thread unless a resume executor has been set.
+	 */
+	template<typename R, typename F>
+	struct awaitable {
+		async_connection& db;
+		F fn;
+		bool is_write;
+		std::future<R> result;
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> h) {
+			auto t = new detail::async_task_impl<R, F>(std::move(fn));
+			t->write = is_write;
+			result = t->promise.get_future();
+			auto& resume = db.m_resume;
+			t->on_done = [h, &resume] {
+				if (resume) {
+					resume(h);
+				} else {
+					h.resume();
+				}
+			};
+			db.enqueue(t);
+		}
+
+		R await_resume() { return result.get(); }
+	};
+
+	template<typename F>
+	auto co_read(F f) -> awaitable<typename detail::async_result<F>::type, F> {
+		return {*this, std::move(f), false, {}};
+	}
+
+	template<typename F>
+	auto co_write(F f) -> awaitable<typename detail::async_result<F>::type, F> {
+		return {*this, std::move(f), true, {}};
+	}
+
+	// set before the first co_await, e.g. to post the handle to an event loop
+	void set_resume_executor(std::function<void(std::coroutine_handle<>)> executor) {
+		m_resume = std::move(executor);
+	}
+#endif
+
+	private:
+	connection m_conn;
+	std::size_t m_max_batch;
+	detail::mpsc_queue m_queue;
+	std::atomic<bool> m_stop{false};
+	std::atomic<bool> m_sleeping{false};
+	std::atomic<std::size_t> m_batches{0};
+	std::atomic<std::size_t> m_writes{0};
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::thread m_worker;
+#ifdef SQLITEPP_HAS_COROUTINES
+	std::function<void(std::coroutine_handle<>)> m_resume;
+#endif
+
+	template<typename F>
+	auto submit(F f, bool write) -> std::future<typename detail::async_result<F>::type> {
+		using result_type = typename detail::async_result<F>::type;
+		auto t = new detail::async_task_impl<result_type, F>(std::move(f));
+		t->write = write;
+		auto result = t->promise.get_future();
+		enqueue(t);
+		return result;
+	}
+
+	/*
+	 * push() and the load of m_sleeping are sequentially consistent, as are
+	 * the store of m_sleeping and empty() in next(): either the worker sees
+	 * the new task before it sleeps, or this thread sees m_sleeping and
+	 * wakes it. With weaker orders both may read the other's old value.
+	 */
+	void enqueue(detail::async_task* t) {
+		m_queue.push(t);
+		if (m_sleeping.load()) {
+			wake();
+		}
+	}
+
+	void wake() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wakeup.notify_one();
+	}
+
+	detail::async_task* next() {
+		for (;;) {
+			if (const auto n = m_queue.pop()) {
+				return static_cast<detail::async_task*>(n);
+			}
+			if (!m_queue.empty()) {
+				std::this_thread::yield(); // a producer is half way through push()
+				continue;
+			}
+			if (m_stop.load()) {
+				return nullptr;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_sleeping.store(true);
+			m_wakeup.wait(lock, [this] { return !m_queue.empty() || m_stop.load(); });
+			m_sleeping.store(false);
+		}
+	}
+
+	static void finish(detail::async_task* t, std::exception_ptr batch_error) {
+		t->publish(batch_error);
+		if (t->on_done) {
+			t->on_done();
+		}
+		delete t;
+	}
+
+	void work() {
+		std::vector<detail::async_task*> batch;
+		batch.reserve(m_max_batch);
+		detail::async_task* t = next();
+		while (t != nullptr) {
+			if (!t->write) {
+				t->run(m_conn);
+				finish(t, nullptr);
+				t = next();
+				continue;
+			}
+			// take every write that is already waiting, stop at the first read
+			batch.push_back(t);
+			t = nullptr;
+			while (batch.size() < m_max_batch) {
+				const auto n = static_cast<detail::async_task*>(m_queue.pop());
+				if (n == nullptr) {
+					break;
+				}
+				if (!n->write) {
+					t = n;
+					break;
+				}
+				batch.push_back(n);
+			}
+			commit(batch);
+			batch.clear();
+			if (t == nullptr) {
+				t = next();
+			}
+		}
+	}
+
+	void commit(const std::vector<detail::async_task*>& batch) {
+		std::size_t first = 0;
+		while (first < batch.size()) {
+			first = commit(batch, first);
+		}
+	}
+
+	/*
+	 * Runs batch[first, ...) in one transaction and finishes those writes.
+	 * Returns where the next transaction has to start, which is before the
+	 * end of the batch when SQLite rolled this one back.
+	 */
+	std::size_t commit(const std::vector<detail::async_task*>& batch, std::size_t first) {
+		const auto db = m_conn.handle.get();
+		std::size_t end = batch.size();
+		std::exception_ptr batch_error;
+		try {
+			detail::run_cached(m_conn, "BEGIN IMMEDIATE");
+			for (std::size_t i = first; i < end; ++i) {
+				const auto w = batch[i];
+				detail::run_cached(m_conn, "SAVEPOINT async_write");
+				w->run(m_conn);
+				if (sqlite3_get_autocommit(db) != 0) {
+					if (!w->failed()) {
+						w->error = std::make_exception_ptr(sql_error(SQLITE_ABORT, "the write ended its batch's transaction"));
+					}
+					batch_error = std::make_exception_ptr(
+						sql_error(SQLITE_ABORT, "rolled back with a later write of the same transaction"));
+					end = i + 1;
+					break;
+				}
+				if (w->failed()) {
+					detail::run_cached(m_conn, "ROLLBACK TO async_write");
+				}
+				detail::run_cached(m_conn, "RELEASE async_write");
+			}
+			if (batch_error == nullptr) {
+				detail::run_cached(m_conn, "COMMIT");
+			}
+		} catch (...) {
+			batch_error = std::current_exception();
+			if (sqlite3_get_autocommit(db) == 0) {
+				detail::run_cached_noexcept(m_conn, "ROLLBACK");
+			}
+		}
+		if (batch_error == nullptr) {
+			++m_batches;
+			for (std::size_t i = first; i < end; ++i) {
+				m_writes += batch[i]->failed() ? 0 : 1;
+			}
+		}
+		for (std::size_t i = first; i < end; ++i) {
+			finish(batch[i], batch_error);
+		}
+		return end;
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __ASYNC_HPP__ */
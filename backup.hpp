@@ -0,0 +1,135 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __BACKUP_HPP__
+#define __BACKUP_HPP__
+
+#include "sqlite.hpp"
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace sqlite {
+
+struct backup_handle_traits {
+	using pointer = sqlite3_backup *;
+
+	static pointer invalid() noexcept { return nullptr; }
+
+	static bool close(pointer value) noexcept { return sqlite3_backup_finish(value) == SQLITE_OK; }
+};
+
+using backup_handle = utils::unique_handle<backup_handle_traits>;
+
+/*
+ * Copies one database into another with sqlite3_backup, a few pages at a
+ * time. The source is only read-locked while a step() runs, so writers
+ * can get in between steps. If another connection writes to the source
+ * meanwhile, SQLite restarts the copy; writes through the source
+ * connection itself are carried over as they happen.
+ *
+ *	auto b = backup::create(snapshot, live);
+ *	b.run(256, std::chrono::milliseconds(5), [](int remaining, int total) { ... });
+ *
+ * Neither connection may be destroyed while the backup is open.
+ */
+struct backup {
+	backup_handle handle;
+
+	using progress = std::function<void(int remaining, int pagecount)>;
+
+	static inline backup create(const connection& destination, const connection& source,
+				    const char* destination_db = "main", const char* source_db = "main") {
+		backup result;
+		result.m_destination = destination.handle.get();
+		result.handle.reset(sqlite3_backup_init(result.m_destination, destination_db, source.handle.get(), source_db));
+		if (!result.handle) {
+			sql_result::from_cmd(sqlite3_errcode(result.m_destination), result.m_destination).throw_error();
+		}
+		return result;
+	}
+
+	/*
+	 * Copies up to pages pages, -1 for all of them. SQLITE_BUSY and
+	 * SQLITE_LOCKED come back unchecked so the caller can retry later;
+	 * anything else throws. The result is done() once the last page
+	 * is copied.
+	 */
+	sql_result step(int pages = -1) {
+		const auto r = sql_result::from_cmd(sqlite3_backup_step(handle.get(), pages), m_destination);
+		if (r.value == SQLITE_BUSY || r.value == SQLITE_LOCKED) {
+			return r;
+		}
+		return r.check();
+	}
+
+	/*
+	 * Steps until the copy is complete, pausing between steps (a yield when
+	 * pause is zero) and after a busy or locked step, then finishes the
+	 * backup. progress, if given, is called after every step.
+	 */
+	void run(int pages_per_step = 64, std::chrono::milliseconds pause = std::chrono::milliseconds(0),
+		 const progress& on_progress = progress()) {
+		for (;;) {
+			if (step(pages_per_step).done()) {
+				break;
+			}
+			if (on_progress) {
+				on_progress(remaining(), pagecount());
+			}
+			if (pause.count() > 0) {
+				std::this_thread::sleep_for(pause);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		if (on_progress) {
+			on_progress(0, pagecount());
+		}
+		finish();
+	}
+
+	// releases the source and reports the outcome of the whole backup
+	void finish() {
+		if (handle) {
+			const auto r = sqlite3_backup_finish(handle.release());
+			sql_result::from_cmd(r, m_destination).check();
+		}
+	}
+
+	// both are only updated by step()
+	inline int remaining() const { return sqlite3_backup_remaining(handle.get()); }
+	inline int pagecount() const { return sqlite3_backup_pagecount(handle.get()); }
+
+	inline bool finished() const noexcept { return !handle; }
+
+	private:
+	sqlite3* m_destination = nullptr;
+};
+
+// copies the file into a fresh in-memory database in one step
+inline connection load_into_memory(const std::string& filename) {
+	auto source = connection::create(filename.c_str(), [] {
+		connection_options options;
+		options.flags = SQLITE_OPEN_READONLY;
+		return options;
+	}());
+	auto result = connection::create_memory();
+	backup::create(result, source).run(-1);
+	return result;
+}
+
+// writes a consistent copy of source's main database to filename
+inline void snapshot(const connection& source, const std::string& filename, int pages_per_step = 64,
+		     std::chrono::milliseconds pause = std::chrono::milliseconds(0),
+		     const backup::progress& on_progress = backup::progress()) {
+	const auto destination = connection::create(filename.c_str());
+	backup::create(destination, source).run(pages_per_step, pause, on_progress);
+}
+
+} /* namespace sqlite  */
+
+#endif /* __BACKUP_HPP__ */
@@ -0,0 +1,266 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+
+// Google Benchmark suite comparing the wrapper with raw sqlite3 calls.
+// Every benchmark takes the storage as its first argument: 0 = :memory:, 1 = a file
+// under $TMPDIR, removed when the suite is done.
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "sqlite.hpp"
+#include "typed_statement.hpp"
+#include "bulk_insert.hpp"
+
+namespace {
+
+std::string temp_path() {
+	const char* dir = std::getenv("TMPDIR");
+	return std::string(dir != nullptr ? dir : "/tmp") + "/sqlitepp11-bench-" + std::to_string(getpid()) + ".db";
+}
+
+const std::string bench_file = temp_path();
+
+void remove_bench_file() {
+	for (const char* suffix : {"", "-journal", "-wal", "-shm"}) {
+		std::remove((bench_file + suffix).c_str());
+	}
+}
+
+sqlite::connection open_db(benchmark::State& state) {
+	if (state.range(0) == 0) {
+		return sqlite::connection::create_memory();
+	}
+	remove_bench_file();
+	return sqlite::connection::create(bench_file.c_str());
+}
+
+void create_table(sqlite::connection& c, int rows) {
+	c.execute("create table Hens ( Id int primary key, Name text not null )");
+	c.execute("BEGIN");
+	auto insert = sqlite::statement::create(c, "insert into Hens (Id, Name) values (?, ?)");
+	for (int i = 0; i < rows; ++i) {
+		insert.bind(1, i).bind(2, "Henrietta").step();
+		insert.reset_binding();
+	}
+	c.execute("COMMIT");
+}
+
+const char* const select_sql = "select Id, Name from Hens where Id = ?";
+
+/* prepare */
+
+void prepare_raw(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	for (auto _ : state) {
+		sqlite3_stmt* stmt = nullptr;
+		sqlite3_prepare_v2(c.handle.get(), select_sql, -1, &stmt, nullptr);
+		sqlite3_finalize(stmt);
+	}
+}
+
+void prepare_wrapper(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	for (auto _ : state) {
+		auto stmt = sqlite::statement::create(c, select_sql);
+		benchmark::DoNotOptimize(stmt.handle.get());
+	}
+}
+
+void prepare_cached(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	const std::string sql = select_sql;
+	for (auto _ : state) {
+		auto stmt = c.prepare_cached(sql);
+		benchmark::DoNotOptimize(stmt.handle.get());
+	}
+}
+
+/* bind + step insert loops, inside one transaction */
+
+void insert_raw(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	sqlite3_stmt* stmt = nullptr;
+	sqlite3_prepare_v2(c.handle.get(), "insert into Hens (Id, Name) values (?, ?)", -1, &stmt, nullptr);
+	const std::string name = "Henrietta";
+	int id = 0;
+	sqlite3_exec(c.handle.get(), "BEGIN", nullptr, nullptr, nullptr);
+	for (auto _ : state) {
+		sqlite3_bind_int(stmt, 1, id++);
+		sqlite3_bind_text(stmt, 2, name.c_str(), name.size(), SQLITE_STATIC);
+		sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+	}
+	sqlite3_exec(c.handle.get(), "COMMIT", nullptr, nullptr, nullptr);
+	sqlite3_finalize(stmt);
+	state.SetItemsProcessed(state.iterations());
+}
+
+void insert_wrapper(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	auto insert = sqlite::statement::create(c, "insert into Hens (Id, Name) values (?, ?)");
+	const std::string name = "Henrietta";
+	int id = 0;
+	c.execute("BEGIN");
+	for (auto _ : state) {
+		insert.bind(1, id++).bind(2, name).step();
+		insert.reset_binding();
+	}
+	c.execute("COMMIT");
+	state.SetItemsProcessed(state.iterations());
+}
+
+void insert_typed(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	auto insert = sqlite::typed_statement<std::tuple<int32_t, std::string>, std::tuple<>>::create(
+		c, "insert into Hens (Id, Name) values (?, ?)");
+	const std::string name = "Henrietta";
+	int32_t id = 0;
+	c.execute("BEGIN");
+	for (auto _ : state) {
+		insert.execute(id++, name);
+	}
+	c.execute("COMMIT");
+	state.SetItemsProcessed(state.iterations());
+}
+
+/* column reads over a full scan */
+
+const int scan_rows = 1000;
+
+void read_raw(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, scan_rows);
+	sqlite3_stmt* stmt = nullptr;
+	sqlite3_prepare_v2(c.handle.get(), "select Id, Name from Hens", -1, &stmt, nullptr);
+	for (auto _ : state) {
+		std::size_t bytes = 0;
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			bytes += sqlite3_column_int(stmt, 0);
+			sqlite3_column_text(stmt, 1);
+			bytes += sqlite3_column_bytes(stmt, 1);
+		}
+		sqlite3_reset(stmt);
+		benchmark::DoNotOptimize(bytes);
+	}
+	sqlite3_finalize(stmt);
+	state.SetItemsProcessed(state.iterations() * scan_rows);
+}
+
+void read_get_string(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, scan_rows);
+	auto select = sqlite::statement::create(c, "select Id, Name from Hens");
+	for (auto _ : state) {
+		std::size_t bytes = 0;
+		while (select.step().has_data()) {
+			bytes += select.get_int(0);
+			bytes += select.get_string(1).size();
+		}
+		select.reset_binding();
+		benchmark::DoNotOptimize(bytes);
+	}
+	state.SetItemsProcessed(state.iterations() * scan_rows);
+}
+
+void read_get_text(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, scan_rows);
+	auto select = sqlite::statement::create(c, "select Id, Name from Hens");
+	for (auto _ : state) {
+		std::size_t bytes = 0;
+		while (select.step().has_data()) {
+			bytes += select.get_int(0);
+			bytes += select.get_text(1).size;
+		}
+		select.reset_binding();
+		benchmark::DoNotOptimize(bytes);
+	}
+	state.SetItemsProcessed(state.iterations() * scan_rows);
+}
+
+/* sql_result construction: binding alone, no step */
+
+void bind_raw(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	auto select = sqlite::statement::create(c, select_sql);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sqlite3_bind_int(select.handle.get(), 1, 42));
+	}
+}
+
+void bind_sql_result(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	auto select = sqlite::statement::create(c, select_sql);
+	for (auto _ : state) {
+		auto r = select.create_binding(1, 42);
+		benchmark::DoNotOptimize(r.value);
+	}
+}
+
+void bind_checked(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	auto select = sqlite::statement::create(c, select_sql);
+	for (auto _ : state) {
+		select.bind(1, 42);
+	}
+}
+
+/* transaction batching: range(1) rows per commit, 1 being autocommit */
+
+void insert_batched(benchmark::State& state) {
+	auto c = open_db(state);
+	create_table(c, 0);
+	sqlite::bulk_options options;
+	options.batch_size = static_cast<std::size_t>(state.range(1));
+	int64_t id = 0;
+	for (auto _ : state) {
+		sqlite::bulk_inserter<int64_t, std::string> insert(c, "Hens", {"Id", "Name"}, options);
+		for (int i = 0; i < 1000; ++i) {
+			insert.insert(id++, std::string("Henrietta"));
+		}
+		insert.flush();
+	}
+	state.SetItemsProcessed(state.iterations() * 1000);
+}
+
+} /* namespace */
+
+BENCHMARK(prepare_raw)->Arg(0)->Arg(1);
+BENCHMARK(prepare_wrapper)->Arg(0)->Arg(1);
+BENCHMARK(prepare_cached)->Arg(0)->Arg(1);
+BENCHMARK(insert_raw)->Arg(0)->Arg(1);
+BENCHMARK(insert_wrapper)->Arg(0)->Arg(1);
+BENCHMARK(insert_typed)->Arg(0)->Arg(1);
+BENCHMARK(read_raw)->Arg(0)->Arg(1);
+BENCHMARK(read_get_string)->Arg(0)->Arg(1);
+BENCHMARK(read_get_text)->Arg(0)->Arg(1);
+BENCHMARK(bind_raw)->Arg(0)->Arg(1);
+BENCHMARK(bind_sql_result)->Arg(0)->Arg(1);
+BENCHMARK(bind_checked)->Arg(0)->Arg(1);
+BENCHMARK(insert_batched)->Args({0, 1})->Args({0, 1000})->Args({1, 1})->Args({1, 1000});
+
+int main(int argc, char** argv) {
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	remove_bench_file();
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __BLOB_HPP__
+#define __BLOB_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <string>
+
+namespace sqlite {
+
+struct blob_handle_traits {
+	using pointer = sqlite3_blob *;
+
+	static pointer invalid() noexcept { return nullptr; }
+
+	static bool close(pointer value) noexcept { return sqlite3_blob_close(value) == SQLITE_OK; }
+};
+
+using blob_handle = utils::unique_handle<blob_handle_traits>;
+
+/*
+ * Incremental access to a single blob through sqlite3_blob_open, so large
+ * values never have to sit in memory in one piece. A blob cannot change its
+ * size this way: reserve the space first with create_binding_zeroblob() and
+ * then fill it in chunks.
+ *
+ *	insert.bind(1, id).create_binding_zeroblob(2, size);
+ *	insert.step();
+ *	auto out = blob_stream::open(c, "files", "data", insert.rowid(), true);
+ *	while (n = source.read(buffer, sizeof buffer)) out.write(buffer, n);
+ *
+ * The stream reads and writes sequentially from its position; read_at() and
+ * write_at() leave the position alone.
+ */
+struct blob_stream {
+	blob_handle handle;
+
+	static inline blob_stream open(const connection& c, const std::string& table, const std::string& column,
+				       int64_t rowid, bool writable = false, const char* database = "main") {
+		blob_stream result;
+		result.m_db = c.handle.get();
+		const auto r = sqlite3_blob_open(result.m_db, database, table.c_str(), column.c_str(),
+						 rowid, writable ? 1 : 0, result.handle.get_address_of());
+		sql_result::from_cmd(r, result.m_db).check();
+		result.m_size = static_cast<std::size_t>(sqlite3_blob_bytes(result.handle.get()));
+		return result;
+	}
+
+	// moves to the same column of another row, much cheaper than a new open()
+	void reopen(int64_t rowid) {
+		const auto r = sqlite3_blob_reopen(handle.get(), rowid);
+		sql_result::from_cmd(r, m_db).check();
+		m_size = static_cast<std::size_t>(sqlite3_blob_bytes(handle.get()));
+		m_position = 0;
+	}
+
+	inline std::size_t size() const noexcept { return m_size; }
+	inline std::size_t tell() const noexcept { return m_position; }
+	inline std::size_t remaining() const noexcept { return m_size - m_position; }
+	inline void seek(std::size_t offset) noexcept { m_position = std::min(offset, m_size); }
+
+	// reads up to n bytes and returns how many were read, 0 at the end
+	std::size_t read(void* buffer, std::size_t n) {
+		n = std::min(n, remaining());
+		read_at(m_position, buffer, n);
+		m_position += n;
+		return n;
+	}
+
+	// throws SQLITE_ERROR when the data does not fit into the blob
+	void write(const void* data, std::size_t n) {
+		write_at(m_position, data, n);
+		m_position += n;
+	}
+
+	void read_at(std::size_t offset, void* buffer, std::size_t n) const {
+		if (n == 0) {
+			return;
+		}
+		const auto r = sqlite3_blob_read(handle.get(), buffer, static_cast<int>(n), static_cast<int>(offset));
+		sql_result::from_cmd(r, m_db).check();
+	}
+
+	void write_at(std::size_t offset, const void* data, std::size_t n) {
+		if (n == 0) {
+			return;
+		}
+		const auto r = sqlite3_blob_write(handle.get(), data, static_cast<int>(n), static_cast<int>(offset));
+		sql_result::from_cmd(r, m_db).check();
+	}
+
+	// reads the rest of the blob through buffer, calling f(data, bytes) per chunk
+	template<typename F>
+	std::size_t read_chunks(void* buffer, std::size_t chunk_size, F&& f) {
+		std::size_t total = 0;
+		std::size_t n;
+		while ((n = read(buffer, chunk_size)) != 0) {
+			f(static_cast<const void*>(buffer), n);
+			total += n;
+		}
+		return total;
+	}
+
+	// closes now and reports the outcome instead of relying on the destructor
+	sql_result close() {
+		const auto r = sqlite3_blob_close(handle.release());
+		return sql_result::from_cmd(r, m_db);
+	}
+
+	private:
+	sqlite3* m_db = nullptr;
+	std::size_t m_size = 0;
+	std::size_t m_position = 0;
+};
+
+} /* namespace sqlite  */
+
+#endif /* __BLOB_HPP__ */
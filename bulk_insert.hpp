@@ -0,0 +1,214 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __BULK_INSERT_HPP__
+#define __BULK_INSERT_HPP__
+
+#include "sqlite.hpp"
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace sqlite {
+
+struct bulk_options {
+	// rows written per transaction
+	std::size_t batch_size = 10000;
+	// rows per INSERT statement; more than one uses VALUES (...),(...)
+	std::size_t rows_per_statement = 1;
+};
+
+/*
+ * Inserts rows of Columns... into one table, wrapping every batch_size rows
+ * in a single transaction instead of paying one commit per row. The table
+ * and column names are quoted, so they are taken literally.
+ *
+ * With rows_per_statement > 1 the rows are buffered (by copy) until a
+ * multi-row statement is full, capped by SQLITE_LIMIT_VARIABLE_NUMBER.
+ * A connection that is already inside a transaction when the inserter is
+ * created keeps it: no batches are committed and the rows become durable
+ * with the caller's COMMIT. Call flush() at the end, which writes the
+ * buffered rows and commits the open batch; rollback(), or destroying the
+ * inserter without flush(), drops the buffered rows and rolls the open
+ * batch back. Batches committed before stay, and so do the rows already
+ * written into a caller's transaction.
+ */
+template<typename... Columns>
+struct bulk_inserter {
+
+	using row = std::tuple<Columns...>;
+	static constexpr std::size_t column_count = sizeof...(Columns);
+
+	bulk_inserter(connection& c, const std::string& table, const std::vector<std::string>& columns,
+		      bulk_options options = bulk_options())
+	: m_conn(c), m_options(options), m_own_transactions(sqlite3_get_autocommit(c.handle.get()) != 0) {
+		if (columns.size() != column_count) {
+			throw sql_error(SQLITE_MISUSE, "bulk_inserter: column names do not match the row type");
+		}
+		if (m_options.batch_size == 0) {
+			m_options.batch_size = 1;
+		}
+		const auto max_vars = static_cast<std::size_t>(sqlite3_limit(c.handle.get(), SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+		const auto max_rows = column_count == 0 ? 1 : max_vars / column_count;
+		if (m_options.rows_per_statement > max_rows) {
+			m_options.rows_per_statement = max_rows;
+		}
+		if (m_options.rows_per_statement == 0) {
+			m_options.rows_per_statement = 1;
+		}
+
+		const auto head = "INSERT INTO " + detail::quote_identifier(table) + " (" + join(columns) + ") VALUES ";
+		m_single = statement::create(c, head + values_clause(1));
+		if (m_options.rows_per_statement > 1) {
+			m_multi = statement::create(c, head + values_clause(m_options.rows_per_statement));
+			m_pending.reserve(m_options.rows_per_statement);
+		}
+	}
+
+	bulk_inserter(const bulk_inserter&) = delete;
+	bulk_inserter& operator=(const bulk_inserter&) = delete;
+
+	// whatever flush() did not get to is rolled back
+	~bulk_inserter() { rollback(); }
+
+	void insert(const row& values) {
+		if (m_options.rows_per_statement == 1) {
+			begin();
+			write(m_single, values, 1);
+			return;
+		}
+		m_pending.push_back(values);
+		if (m_pending.size() == m_options.rows_per_statement) {
+			write_pending();
+		}
+	}
+
+	template<typename... T>
+	void insert(const T&... values) {
+		insert(row(values...));
+	}
+
+	// any range whose elements convert to row
+	template<typename Range>
+	void insert_range(const Range& rows) {
+		for (const auto& r : rows) {
+			insert(r);
+		}
+	}
+
+	// writes buffered rows and commits the open batch
+	void flush() {
+		if (!m_pending.empty()) {
+			begin();
+			for (const auto& r : m_pending) {
+				write(m_single, r, 1);
+			}
+			m_pending.clear();
+		}
+		commit();
+	}
+
+	// drops the buffered rows and rolls the open batch back
+	void rollback() noexcept {
+		if (m_open) {
+			detail::run_cached_noexcept(m_conn, "ROLLBACK");
+			m_open = false;
+			m_in_batch = 0;
+		}
+		m_pending.clear();
+	}
+
+	inline std::size_t rows_inserted() const noexcept { return m_inserted; }
+	inline std::size_t batches_committed() const noexcept { return m_batches; }
+
+	private:
+	connection& m_conn;
+	bulk_options m_options;
+	statement m_single;
+	statement m_multi;
+	std::vector<row> m_pending;
+	std::size_t m_in_batch = 0;
+	std::size_t m_inserted = 0;
+	std::size_t m_batches = 0;
+	bool m_own_transactions;
+	bool m_open = false;
+
+	static std::string join(const std::vector<std::string>& names) {
+		std::string result;
+		for (const auto& n : names) {
+			if (!result.empty()) {
+				result += ", ";
+			}
+			result += detail::quote_identifier(n);
+		}
+		return result;
+	}
+
+	static std::string values_clause(std::size_t rows) {
+		std::string tuple = "(";
+		for (std::size_t i = 0; i < column_count; ++i) {
+			tuple += i == 0 ? "?" : ", ?";
+		}
+		tuple += ")";
+		std::string result;
+		for (std::size_t i = 0; i < rows; ++i) {
+			if (i != 0) {
+				result += ", ";
+			}
+			result += tuple;
+		}
+		return result;
+	}
+
+	void begin() {
+		if (m_own_transactions && !m_open) {
+			detail::run_cached(m_conn, "BEGIN");
+			m_open = true;
+		}
+	}
+
+	void commit() {
+		if (m_open) {
+			detail::run_cached(m_conn, "COMMIT");
+			m_open = false;
+			m_in_batch = 0;
+			++m_batches;
+		}
+	}
+
+	void write(statement& stmt, const row& values, std::size_t rows) {
+		stmt.bind_tuple(values, 1);
+		finish(stmt, rows);
+	}
+
+	void write_pending() {
+		begin();
+		int first = 1;
+		for (const auto& r : m_pending) {
+			m_multi.bind_tuple(r, first);
+			first += static_cast<int>(column_count);
+		}
+		finish(m_multi, m_pending.size());
+		m_pending.clear();
+	}
+
+	void finish(statement& stmt, std::size_t rows) {
+		const auto r = stmt.try_step();
+		stmt.reset_binding();
+		r.check();
+		m_inserted += rows;
+		m_in_batch += rows;
+		if (m_open && m_in_batch >= m_options.batch_size) {
+			commit();
+		}
+	}
+};
+
+template<typename... Columns>
+constexpr std::size_t bulk_inserter<Columns...>::column_count;
+
+} /* namespace sqlite  */
+
+#endif /* __BULK_INSERT_HPP__ */
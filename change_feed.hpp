@@ -0,0 +1,221 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __CHANGE_FEED_HPP__
+#define __CHANGE_FEED_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlite {
+
+enum change_op {
+	CHANGE_INSERT = SQLITE_INSERT,
+	CHANGE_UPDATE = SQLITE_UPDATE,
+	CHANGE_DELETE = SQLITE_DELETE
+};
+
+// names point into the feed and stay valid as long as it does
+struct change_event {
+	change_op op;
+	const std::string* database;
+	const std::string* table;
+	int64_t rowid;
+};
+
+/*
+ * The changes of one committed transaction. If it changed more rows than
+ * the feed's capacity, the rest were dropped and overflowed is set;
+ * tables still lists every table that was touched, so such a batch can be
+ * handled as "these tables changed".
+ */
+struct change_batch {
+	const change_event* events;
+	std::size_t size;
+	bool overflowed;
+	const std::vector<const std::string*>& tables;
+
+	inline const change_event* begin() const noexcept { return events; }
+	inline const change_event* end() const noexcept { return events + size; }
+};
+
+struct change_feed_stats {
+	uint64_t commits = 0;    // batches delivered
+	uint64_t events = 0;     // events delivered
+	uint64_t overflows = 0;  // batches that dropped events
+	uint64_t rollbacks = 0;  // transactions rolled back after changing rows, failed commits included
+	uint64_t failed_commits = 0; // delivered batches whose commit then failed
+	uint64_t subscriber_errors = 0; // exceptions thrown by subscribers
+};
+
+/*
+ * Turns sqlite3_update_hook, sqlite3_commit_hook and sqlite3_rollback_hook
+ * of one connection into a feed of (operation, table, rowid) batches, one
+ * per committed transaction. Events are collected in a buffer allocated
+ * once up front, table names are interned, so a change costs a few
+ * stores; a rollback discards the batch.
+ *
+ *	change_feed feed(c);
+ *	feed.subscribe([&](const change_batch& b) { for (auto& e : b) cache.erase(*e.table, e.rowid); });
+ *
+ * Subscribers run inside the commit hook on the connection's thread, so
+ * a batch means "about to commit", not "committed": SQLite holds the
+ * exclusive lock by then, but writing the commit can still fail (disk
+ * full, I/O error), and there is no hook that runs after a commit. A
+ * delivered batch is never taken back; when its commit fails, the
+ * rollback hook counts it in failed_commits (and rollbacks). Subscribers
+ * that must not act on a lost commit have to check that; an invalidating
+ * cache can take a batch as "these rows may have changed" and need not.
+ * Subscribers must not use the connection, but may subscribe and
+ * unsubscribe; a new subscriber gets the next batch.
+ * Exceptions they throw are counted and dropped. SQLite does not report
+ * everything; the missing cases are:
+ * ROLLBACK TO a savepoint (its events are still delivered), WITHOUT ROWID
+ * tables, and DELETE without WHERE, which truncates the table without
+ * calling the update hook. The hooks are one per connection, so a feed
+ * replaces whatever was installed; the connection must outlive the feed.
+ */
+struct change_feed {
+
+	using subscriber = std::function<void(const change_batch&)>;
+
+	explicit change_feed(connection& c, std::size_t capacity = 4096) : m_db(c.handle.get()) {
+		m_events.resize(capacity);
+		sqlite3_update_hook(m_db, &change_feed::on_update, this);
+		sqlite3_commit_hook(m_db, &change_feed::on_commit, this);
+		sqlite3_rollback_hook(m_db, &change_feed::on_rollback, this);
+	}
+
+	change_feed(const change_feed&) = delete;
+	change_feed& operator=(const change_feed&) = delete;
+
+	~change_feed() {
+		sqlite3_update_hook(m_db, nullptr, nullptr);
+		sqlite3_commit_hook(m_db, nullptr, nullptr);
+		sqlite3_rollback_hook(m_db, nullptr, nullptr);
+	}
+
+	// returns an id for unsubscribe()
+	std::size_t subscribe(subscriber s) {
+		m_subscribers.emplace_back(new subscriber(std::move(s)));
+		return m_subscribers.size() - 1;
+	}
+
+	void unsubscribe(std::size_t id) {
+		if (id < m_subscribers.size()) {
+			m_subscribers[id].reset();
+		}
+	}
+
+	inline std::size_t capacity() const noexcept { return m_events.size(); }
+	inline const change_feed_stats& stats() const noexcept { return m_stats; }
+
+	private:
+	sqlite3* m_db;
+	std::vector<change_event> m_events;
+	std::size_t m_size = 0;
+	bool m_overflowed = false;
+	std::vector<std::unique_ptr<std::string>> m_names;
+	const std::string* m_last_database = nullptr;
+	const std::string* m_last_table = nullptr;
+	std::vector<const std::string*> m_tables; // touched by the open transaction
+	bool m_delivered = false; // a batch went out and no change has come since
+	// shared, so one that unsubscribes itself while it runs stays alive
+	std::vector<std::shared_ptr<subscriber>> m_subscribers;
+	change_feed_stats m_stats;
+
+	// a linear scan is fine for a schema's worth of names
+	const std::string* intern(const char* name, const std::string*& last) {
+		if (last != nullptr && std::strcmp(last->c_str(), name) == 0) {
+			return last;
+		}
+		for (const auto& n : m_names) {
+			if (std::strcmp(n->c_str(), name) == 0) {
+				return last = n.get();
+			}
+		}
+		m_names.emplace_back(new std::string(name));
+		return last = m_names.back().get();
+	}
+
+	void clear() noexcept {
+		m_size = 0;
+		m_overflowed = false;
+		m_tables.clear();
+	}
+
+	static void on_update(void* self, int op, const char* database, const char* table, sqlite3_int64 rowid) {
+		auto& f = *static_cast<change_feed*>(self);
+		f.m_delivered = false;
+		try {
+			const auto t = f.intern(table, f.m_last_table);
+			if ((f.m_tables.empty() || f.m_tables.back() != t)
+			    && std::find(f.m_tables.begin(), f.m_tables.end(), t) == f.m_tables.end()) {
+				f.m_tables.push_back(t);
+			}
+			if (f.m_size == f.m_events.size()) {
+				f.m_overflowed = true;
+				return;
+			}
+			f.m_events[f.m_size++] = change_event{static_cast<change_op>(op), f.intern(database, f.m_last_database), t, rowid};
+		} catch (...) {
+			f.m_overflowed = true; // out of memory for a new name
+		}
+	}
+
+	static int on_commit(void* self) {
+		auto& f = *static_cast<change_feed*>(self);
+		if (f.m_size == 0 && !f.m_overflowed) {
+			return 0; // a read-only or empty transaction
+		}
+		const change_batch batch{f.m_events.data(), f.m_size, f.m_overflowed, f.m_tables};
+		++f.m_stats.commits;
+		f.m_stats.events += f.m_size;
+		f.m_stats.overflows += f.m_overflowed ? 1 : 0;
+		// by index: subscribe() from a subscriber may reallocate the vector
+		const auto subscribers = f.m_subscribers.size();
+		for (std::size_t i = 0; i < subscribers; ++i) {
+			const auto s = f.m_subscribers[i];
+			if (!s) {
+				continue;
+			}
+			try {
+				(*s)(batch);
+			} catch (...) {
+				++f.m_stats.subscriber_errors;
+			}
+		}
+		f.clear();
+		f.m_delivered = true;
+		return 0;
+	}
+
+	static void on_rollback(void* self) {
+		auto& f = *static_cast<change_feed*>(self);
+		if (f.m_size != 0 || f.m_overflowed) {
+			++f.m_stats.rollbacks;
+		}
+		/*
+		 * A failing commit rolls back with autocommit already on, an
+		 * explicit ROLLBACK or an error inside a transaction with it
+		 * still off.
+		 */
+		if (f.m_delivered && sqlite3_get_autocommit(f.m_db) != 0) {
+			++f.m_stats.failed_commits;
+			++f.m_stats.rollbacks;
+		}
+		f.m_delivered = false;
+		f.clear();
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __CHANGE_FEED_HPP__ */
@@ -0,0 +1,206 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __CHECKPOINT_HPP__
+#define __CHECKPOINT_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sqlite {
+
+struct checkpoint_options {
+	int wal_frames = 1000;      // wake the checkpointer once a commit leaves this many frames
+	int restart_frames = 10000; // at this size, wait for readers (RESTART/TRUNCATE) instead of PASSIVE
+	bool truncate = true;       // prefer TRUNCATE over RESTART where SQLite has it
+	std::chrono::milliseconds interval{1000}; // PASSIVE checkpoint at least this often while the WAL grows
+	int busy_timeout = 100;     // milliseconds a RESTART waits for the writer and readers
+};
+
+struct checkpoint_stats {
+	uint64_t checkpoints = 0; // completed sqlite3_wal_checkpoint_v2 calls
+	uint64_t passive = 0;
+	uint64_t restart = 0;     // RESTART or TRUNCATE
+	uint64_t busy = 0;        // checkpoints that could not finish (SQLITE_BUSY)
+	int wal_frames = 0;       // WAL size after the last commit, in frames
+	int max_wal_frames = 0;
+	int64_t wal_bytes = 0;    // wal_frames in bytes, pages only
+	int last_checkpointed = 0; // frames copied back by the last checkpoint
+	uint64_t last_ns = 0;
+	uint64_t max_ns = 0;
+	uint64_t total_ns = 0;
+};
+
+/*
+ * Moves WAL checkpoints off the commit path. attach() replaces the
+ * auto-checkpoint of a writer connection with a sqlite3_wal_hook that only
+ * records the WAL size and wakes this object's thread, which checkpoints
+ * through a connection of its own.
+ *
+ * Checkpoints are PASSIVE, so they never block readers or the writer;
+ * once the WAL reaches restart_frames they escalate to RESTART (TRUNCATE
+ * in SQLite builds that have it), which waits for readers to move past
+ * the end of the WAL so it can be reused from the start. RESTART holds
+ * the write lock while it waits, so writers may stall for up to
+ * busy_timeout then; keep it short. Requires the
+ * sqlitepp11_mt library; attached connections must be detach()ed before
+ * the checkpointer is destroyed.
+ */
+struct wal_checkpointer {
+
+	explicit wal_checkpointer(const std::string& filename, checkpoint_options options = checkpoint_options(),
+				  connection_options open_options = connection_options())
+	: m_options(options), m_trigger(options.wal_frames) {
+		open_options.busy_timeout = options.busy_timeout;
+		auto ready = std::make_shared<std::promise<void>>();
+		auto opened = ready->get_future();
+		m_worker = std::thread([this, filename, open_options, ready] {
+			connection c;
+			try {
+				c = connection::create(filename.c_str(), open_options);
+				// a connection only opens the WAL once it has read something
+				c.execute("SELECT count(*) FROM sqlite_master");
+				auto page_size = statement::create(c, "PRAGMA page_size");
+				page_size.step();
+				m_page_size = page_size.get_int64(0);
+			} catch (...) {
+				ready->set_exception(std::current_exception());
+				return;
+			}
+			ready->set_value();
+			work(c);
+		});
+		try {
+			opened.get();
+		} catch (...) {
+			m_worker.join();
+			throw;
+		}
+	}
+
+	wal_checkpointer(const wal_checkpointer&) = delete;
+	wal_checkpointer& operator=(const wal_checkpointer&) = delete;
+
+	~wal_checkpointer() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wakeup.notify_one();
+		m_worker.join();
+	}
+
+	// sqlite3_wal_hook replaces SQLite's own auto-checkpoint
+	void attach(const connection& c) { sqlite3_wal_hook(c.handle.get(), &wal_checkpointer::on_commit, this); }
+
+	// back to SQLite's default auto-checkpoint of 1000 pages
+	void detach(const connection& c) { sqlite3_wal_autocheckpoint(c.handle.get(), 1000); }
+
+	// checkpoint now instead of at the next threshold or interval
+	void request() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requested = true;
+		}
+		m_wakeup.notify_one();
+	}
+
+	checkpoint_stats stats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto result = m_stats;
+		result.wal_frames = m_frames.load();
+		result.max_wal_frames = std::max(result.max_wal_frames, result.wal_frames);
+		result.wal_bytes = static_cast<int64_t>(result.wal_frames) * m_page_size;
+		return result;
+	}
+
+	private:
+	checkpoint_options m_options;
+	int64_t m_page_size = 0;
+	std::atomic<int> m_frames{0};
+	std::atomic<int> m_trigger;         // WAL size that wakes the worker
+	std::atomic<bool> m_signalled{false};
+	bool m_requested = false;
+	bool m_stop = false;
+	checkpoint_stats m_stats;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::thread m_worker;
+
+	// runs on the committing thread, so it only takes the lock to wake the worker
+	static int on_commit(void* self, sqlite3*, const char*, int frames) {
+		auto& c = *static_cast<wal_checkpointer*>(self);
+		c.m_frames.store(frames);
+		if (frames >= c.m_trigger.load() && !c.m_signalled.exchange(true)) {
+			c.request();
+		}
+		return SQLITE_OK;
+	}
+
+	void work(connection& c) {
+		int last_frames = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop) {
+			m_wakeup.wait_for(lock, m_options.interval, [this] { return m_requested || m_stop; });
+			if (m_stop) {
+				break;
+			}
+			const bool requested = m_requested;
+			m_requested = false;
+			const int frames = m_frames.load();
+			if (!requested && (frames == 0 || frames == last_frames)) {
+				continue;
+			}
+			lock.unlock();
+			last_frames = checkpoint(c, frames);
+			// a reader held the checkpoint back: wait for the WAL to grow some more
+			m_trigger.store(last_frames < 0 ? frames + m_options.wal_frames : m_options.wal_frames);
+			m_signalled.store(false);
+			lock.lock();
+		}
+	}
+
+	// the WAL size if every frame made it back into the database, else -1
+	int checkpoint(connection& c, int frames) {
+		int mode = SQLITE_CHECKPOINT_PASSIVE;
+		if (frames >= m_options.restart_frames) {
+			mode = SQLITE_CHECKPOINT_RESTART;
+#ifdef SQLITE_CHECKPOINT_TRUNCATE
+			if (m_options.truncate) {
+				mode = SQLITE_CHECKPOINT_TRUNCATE;
+			}
+#endif
+		}
+		int log = 0;
+		int copied = 0;
+		const auto start = std::chrono::steady_clock::now();
+		const int r = sqlite3_wal_checkpoint_v2(c.handle.get(), nullptr, mode, &log, &copied);
+		const auto ns = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_stats.checkpoints;
+		++(mode == SQLITE_CHECKPOINT_PASSIVE ? m_stats.passive : m_stats.restart);
+		m_stats.busy += r == SQLITE_BUSY ? 1 : 0;
+		m_stats.max_wal_frames = std::max(m_stats.max_wal_frames, frames);
+		m_stats.last_checkpointed = copied;
+		m_stats.last_ns = ns;
+		m_stats.max_ns = std::max(m_stats.max_ns, ns);
+		m_stats.total_ns += ns;
+		return r == SQLITE_OK && copied == log ? log : -1;
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __CHECKPOINT_HPP__ */
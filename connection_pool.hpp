@@ -0,0 +1,208 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __CONNECTION_POOL_HPP__
+#define __CONNECTION_POOL_HPP__
+
+#include "sqlite.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sqlite {
+
+/*
+ * A fixed set of connections handed out through RAII leases. Each connection
+ * is used by one thread at a time, which is exactly what SQLITE_THREADSAFE=2
+ * allows, so link against sqlitepp11_mt when using it.
+ *
+ * An idle connection that the calling thread used last is preferred, which
+ * keeps its statement cache and page cache warm for that thread. At most
+ * max_waiters threads may block for a connection; the next one gets a
+ * sql_error with SQLITE_BUSY instead of joining the queue.
+ */
+struct connection_pool {
+
+	using factory = std::function<connection()>;
+
+	struct lease {
+
+		lease(lease&& rhs) noexcept : m_pool(rhs.m_pool), m_slot(rhs.m_slot) { rhs.m_pool = nullptr; }
+
+		lease& operator=(lease&& rhs) noexcept {
+			if (this != &rhs) {
+				release();
+				m_pool = rhs.m_pool;
+				m_slot = rhs.m_slot;
+				rhs.m_pool = nullptr;
+			}
+			return *this;
+		}
+
+		lease(const lease&) = delete;
+		lease& operator=(const lease&) = delete;
+
+		~lease() { release(); }
+
+		inline connection& get() const noexcept { return m_pool->m_slots[m_slot].conn; }
+		inline connection& operator*() const noexcept { return get(); }
+		inline connection* operator->() const noexcept { return &get(); }
+
+		// hands the connection back early
+		void release() noexcept {
+			if (m_pool != nullptr) {
+				m_pool->give_back(m_slot);
+				m_pool = nullptr;
+			}
+		}
+
+		private:
+		friend struct connection_pool;
+
+		connection_pool* m_pool;
+		std::size_t m_slot;
+
+		lease(connection_pool& pool, std::size_t slot) noexcept : m_pool(&pool), m_slot(slot) {}
+	};
+
+	connection_pool(factory make, std::size_t size, std::size_t max_waiters = 64)
+	: m_max_waiters(max_waiters) {
+		m_slots.reserve(size);
+		m_idle.reserve(size);
+		for (std::size_t i = 0; i < size; ++i) {
+			m_slots.push_back(slot{make(), std::thread::id()});
+			m_idle.push_back(i);
+		}
+	}
+
+	connection_pool(const connection_pool&) = delete;
+	connection_pool& operator=(const connection_pool&) = delete;
+
+	lease acquire() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_idle.empty()) {
+			enter_queue();
+			m_available.wait(lock, [this] { return !m_idle.empty(); });
+			--m_waiters;
+		}
+		return lease(*this, take());
+	}
+
+	// throws sql_error(SQLITE_BUSY) if nothing came free within timeout
+	template<typename Rep, typename Period>
+	lease acquire(const std::chrono::duration<Rep, Period>& timeout) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_idle.empty()) {
+			enter_queue();
+			const bool ready = m_available.wait_for(lock, timeout, [this] { return !m_idle.empty(); });
+			--m_waiters;
+			if (!ready) {
+				throw sql_error(SQLITE_BUSY, "timed out waiting for a pooled connection");
+			}
+		}
+		return lease(*this, take());
+	}
+
+	inline std::size_t size() const noexcept { return m_slots.size(); }
+
+	std::size_t idle() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_idle.size();
+	}
+
+	// runs f on every connection, one after another; the pool must be idle
+	template<typename F>
+	void for_each(F&& f) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& s : m_slots) {
+			f(s.conn);
+		}
+	}
+
+	/*
+	 * connection::warmup() on every connection, each on its own thread;
+	 * the pool must be idle. The first failure is rethrown once all
+	 * threads are done.
+	 */
+	void warmup(const statement_registry& registry, bool warm_pages = true) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		std::vector<std::thread> workers;
+		for (auto& s : m_slots) {
+			workers.emplace_back([&registry, warm_pages, &s, &error, &error_mutex] {
+				try {
+					s.conn.warmup(registry, warm_pages);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+			});
+		}
+		for (auto& t : workers) {
+			t.join();
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	private:
+	struct slot {
+		connection conn;
+		std::thread::id owner; // last thread that leased it
+	};
+
+	std::vector<slot> m_slots;
+	std::vector<std::size_t> m_idle; // most recently returned last
+	std::size_t m_waiters = 0;
+	std::size_t m_max_waiters;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_available;
+
+	void enter_queue() {
+		if (m_waiters >= m_max_waiters) {
+			throw sql_error(SQLITE_BUSY, "connection pool wait queue is full");
+		}
+		++m_waiters;
+	}
+
+	// caller holds the lock and m_idle is not empty
+	std::size_t take() {
+		const auto self = std::this_thread::get_id();
+		auto it = m_idle.end();
+		while (it != m_idle.begin()) {
+			--it;
+			if (m_slots[*it].owner == self) {
+				break;
+			}
+		}
+		if (m_slots[*it].owner != self) {
+			it = m_idle.end() - 1;
+		}
+		const auto result = *it;
+		m_idle.erase(it);
+		m_slots[result].owner = self;
+		return result;
+	}
+
+	void give_back(std::size_t index) noexcept {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_idle.push_back(index);
+		}
+		m_available.notify_one();
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __CONNECTION_POOL_HPP__ */
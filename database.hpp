@@ -0,0 +1,147 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __DATABASE_HPP__
+#define __DATABASE_HPP__
+
+#include "async.hpp"
+#include "connection_pool.hpp"
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace sqlite {
+
+namespace detail {
+
+	template<typename F>
+	struct statement_result {
+		using type = typename std::decay<decltype(std::declval<F&>()(std::declval<statement&>()))>::type;
+	};
+
+	template<typename R>
+	struct promise_setter {
+		template<typename F>
+		static void set(std::promise<R>& p, F&& f) { p.set_value(f()); }
+	};
+
+	template<>
+	struct promise_setter<void> {
+		template<typename F>
+		static void set(std::promise<void>& p, F&& f) {
+			f();
+			p.set_value();
+		}
+	};
+
+} /* namespace detail */
+
+/*
+ * One database file behind a single writer and a pool of read-only
+ * connections. Under WAL the readers never wait for the writer, so reads
+ * scale with the number of readers while writes are serialized (and
+ * coalesced) on the async_connection's thread.
+ *
+ * execute() routes a statement by sqlite3_stmt_readonly(): read-only SQL
+ * runs on the calling thread with a leased reader, everything else is
+ * queued to the writer. The decision is remembered per SQL text.
+ * Requires the sqlitepp11_mt library.
+ */
+struct database {
+
+	database(const std::string& filename, std::size_t readers,
+		 const connection_options& options = connection_options::read_heavy(), std::size_t max_waiters = 64)
+	: m_writer([filename, options] { return connection::create(filename.c_str(), options); }),
+	  m_readers([filename, options] { return connection::create(filename.c_str(), read_only(options)); },
+		    readers, max_waiters) {}
+
+	database(const database&) = delete;
+	database& operator=(const database&) = delete;
+
+	// f(connection&) on a reader, on the calling thread
+	template<typename F>
+	auto read(F f) -> typename detail::async_result<F>::type {
+		auto lease = m_readers.acquire();
+		return f(*lease);
+	}
+
+	// f(connection&) on the writer thread
+	template<typename F>
+	auto write(F f) -> std::future<typename detail::async_result<F>::type> {
+		return m_writer.write(std::move(f));
+	}
+
+	/*
+	 * Prepares sql (through the statement caches) on whichever side it
+	 * belongs to and calls f(statement&) there. Reads have finished by
+	 * the time this returns; writes complete with the returned future.
+	 */
+	template<typename F>
+	auto execute(const std::string& sql, F f) -> std::future<typename detail::statement_result<F>::type> {
+		using result_type = typename detail::statement_result<F>::type;
+		int kind = classify(sql);
+		if (kind != is_write) {
+			auto lease = m_readers.acquire();
+			auto stmt = lease->prepare_cached(sql);
+			if (kind == unknown) {
+				kind = remember(sql, sqlite3_stmt_readonly(stmt.handle.get()) != 0);
+			}
+			if (kind == is_read) {
+				return run_now<result_type>(f, stmt);
+			}
+		}
+		return m_writer.write([sql, f](connection& c) mutable -> result_type {
+			auto stmt = c.prepare_cached(sql);
+			return f(stmt);
+		});
+	}
+
+	inline async_connection& writer() noexcept { return m_writer; }
+	inline connection_pool& readers() noexcept { return m_readers; }
+
+	private:
+	enum { unknown, is_read, is_write };
+
+	async_connection m_writer;
+	connection_pool m_readers;
+	std::mutex m_mutex;
+	std::unordered_map<std::string, bool> m_readonly;
+
+	static connection_options read_only(connection_options options) {
+		options.flags = (options.flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+		return options;
+	}
+
+	int classify(const std::string& sql) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto it = m_readonly.find(sql);
+		if (it == m_readonly.end()) {
+			return unknown;
+		}
+		return it->second ? is_read : is_write;
+	}
+
+	int remember(const std::string& sql, bool readonly) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_readonly[sql] = readonly;
+		return readonly ? is_read : is_write;
+	}
+
+	template<typename R, typename F>
+	static std::future<R> run_now(F& f, statement& stmt) {
+		std::promise<R> p;
+		try {
+			detail::promise_setter<R>::set(p, [&f, &stmt] { return f(stmt); });
+		} catch (...) {
+			p.set_exception(std::current_exception());
+		}
+		return p.get_future();
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __DATABASE_HPP__ */
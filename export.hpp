@@ -0,0 +1,660 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __EXPORT_HPP__
+#define __EXPORT_HPP__
+
+#include "sqlite.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace sqlite {
+
+/*
+ * A large reusable byte buffer in front of a sink (a file descriptor, a
+ * string, anything taking bytes). Chunks bigger than half the buffer skip
+ * the copy and go to the sink directly. The destructor flushes but drops
+ * errors; call flush() to see them.
+ */
+struct output_buffer {
+
+	using sink = std::function<void(const char* data, std::size_t size)>;
+
+	explicit output_buffer(sink s, std::size_t capacity = 1 << 20)
+	: m_sink(std::move(s)), m_buffer(capacity < 256 ? 256 : capacity) {}
+
+	// write(2) until everything is out; errors throw sql_error(SQLITE_IOERR)
+	static inline output_buffer to_fd(int fd, std::size_t capacity = 1 << 20) {
+		return output_buffer([fd](const char* data, std::size_t size) {
+			while (size > 0) {
+				const auto n = ::write(fd, data, size);
+				if (n < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					throw sql_error(SQLITE_IOERR, std::string("export: write failed: ") + std::strerror(errno));
+				}
+				data += n;
+				size -= static_cast<std::size_t>(n);
+			}
+		}, capacity);
+	}
+
+	static inline output_buffer to_string(std::string& out, std::size_t capacity = 1 << 20) {
+		return output_buffer([&out](const char* data, std::size_t size) { out.append(data, size); }, capacity);
+	}
+
+	// the moved-from buffer is left without a sink and holds nothing to flush
+	output_buffer(output_buffer&& rhs)
+	: m_sink(std::move(rhs.m_sink)), m_buffer(std::move(rhs.m_buffer)), m_used(rhs.m_used), m_written(rhs.m_written) {
+		rhs.m_sink = nullptr;
+		rhs.m_used = 0;
+	}
+
+	output_buffer(const output_buffer&) = delete;
+	output_buffer& operator=(const output_buffer&) = delete;
+
+	~output_buffer() {
+		try {
+			flush();
+		} catch (...) {
+		}
+	}
+
+	// room for n bytes; finish with commit(end)
+	inline char* reserve(std::size_t n) {
+		if (m_buffer.size() - m_used < n) {
+			flush();
+			if (m_buffer.size() < n) {
+				m_buffer.resize(n);
+			}
+		}
+		return m_buffer.data() + m_used;
+	}
+
+	inline void commit(char* end) noexcept { m_used = static_cast<std::size_t>(end - m_buffer.data()); }
+
+	inline void put(char c) { *reserve(1) = c; ++m_used; }
+
+	void append(const char* data, std::size_t size) {
+		if (size > m_buffer.size() / 2) {
+			flush();
+			m_sink(data, size);
+			m_written += size;
+			return;
+		}
+		std::memcpy(reserve(size), data, size);
+		m_used += size;
+	}
+
+	inline void append(const std::string& s) { append(s.data(), s.size()); }
+
+	void flush() {
+		if (m_used > 0 && m_sink) {
+			const auto n = m_used;
+			m_used = 0;
+			m_sink(m_buffer.data(), n);
+			m_written += n;
+		}
+	}
+
+	// bytes handed to the sink so far
+	inline std::size_t bytes_written() const noexcept { return m_written; }
+
+	private:
+	sink m_sink;
+	std::vector<char> m_buffer;
+	std::size_t m_used = 0;
+	std::size_t m_written = 0;
+};
+
+namespace detail {
+
+	// two decimal digits per lookup; at most 20 characters
+	inline char* write_int64(char* out, int64_t value) noexcept {
+		static const char digits[] =
+			"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		uint64_t v = static_cast<uint64_t>(value);
+		if (value < 0) {
+			*out++ = '-';
+			v = 0 - v;
+		}
+		char tmp[20];
+		char* p = tmp + sizeof tmp;
+		while (v >= 100) {
+			const auto i = static_cast<std::size_t>(v % 100) * 2;
+			v /= 100;
+			*--p = digits[i + 1];
+			*--p = digits[i];
+		}
+		if (v >= 10) {
+			const auto i = static_cast<std::size_t>(v) * 2;
+			*--p = digits[i + 1];
+			*--p = digits[i];
+		} else {
+			*--p = static_cast<char>('0' + v);
+		}
+		const auto n = static_cast<std::size_t>(tmp + sizeof tmp - p);
+		std::memcpy(out, p, n);
+		return out + n;
+	}
+
+	inline void write_integer_column(output_buffer& out, sqlite3_stmt* stmt, int column) {
+		out.commit(write_int64(out.reserve(20), sqlite3_column_int64(stmt, column)));
+	}
+
+	// SQLite's own "%!.15g" rendering, which does not depend on the locale
+	inline text_view real_column_text(sqlite3_stmt* stmt, int column) noexcept {
+		const auto data = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+		return text_view{data, static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))};
+	}
+
+	inline text_view raw_column_text(sqlite3_stmt* stmt, int column) noexcept {
+		const auto data = reinterpret_cast<const char*>(
+			sqlite3_column_type(stmt, column) == SQLITE_BLOB ? sqlite3_column_blob(stmt, column)
+									  : sqlite3_column_text(stmt, column));
+		const auto size = static_cast<std::size_t>(sqlite3_column_bytes(stmt, column));
+		return text_view{data != nullptr ? data : "", size};
+	}
+
+	inline void write_csv_field(output_buffer& out, const text_view& text, char delimiter) {
+		bool quote = false;
+		for (const char c : text) {
+			if (c == delimiter || c == '"' || c == '\n' || c == '\r') {
+				quote = true;
+				break;
+			}
+		}
+		if (!quote) {
+			out.append(text.data, text.size);
+			return;
+		}
+		out.put('"');
+		auto start = text.begin();
+		for (auto p = text.begin(); p != text.end(); ++p) {
+			if (*p == '"') {
+				out.append(start, static_cast<std::size_t>(p + 1 - start));
+				start = p; // the quote goes out twice
+			}
+		}
+		out.append(start, static_cast<std::size_t>(text.end() - start));
+		out.put('"');
+	}
+
+	inline void write_json_string(output_buffer& out, const char* data, std::size_t size) {
+		static const char hex[] = "0123456789abcdef";
+		out.put('"');
+		auto start = data;
+		const auto end = data + size;
+		for (auto p = data; p != end; ++p) {
+			const auto c = static_cast<unsigned char>(*p);
+			if (c >= 0x20 && c != '"' && c != '\\') {
+				continue;
+			}
+			out.append(start, static_cast<std::size_t>(p - start));
+			start = p + 1;
+			auto w = out.reserve(6);
+			*w++ = '\\';
+			switch (c) {
+				case '"': *w++ = '"'; break;
+				case '\\': *w++ = '\\'; break;
+				case '\n': *w++ = 'n'; break;
+				case '\r': *w++ = 'r'; break;
+				case '\t': *w++ = 't'; break;
+				default:
+					*w++ = 'u';
+					*w++ = '0';
+					*w++ = '0';
+					*w++ = hex[c >> 4];
+					*w++ = hex[c & 15];
+			}
+			out.commit(w);
+		}
+		out.append(start, static_cast<std::size_t>(end - start));
+		out.put('"');
+	}
+
+	inline void write_base64(output_buffer& out, const unsigned char* data, std::size_t size) {
+		static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		auto w = out.reserve((size + 2) / 3 * 4 + 2);
+		*w++ = '"';
+		std::size_t i = 0;
+		for (; i + 3 <= size; i += 3) {
+			const uint32_t v = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+			*w++ = table[v >> 18];
+			*w++ = table[(v >> 12) & 63];
+			*w++ = table[(v >> 6) & 63];
+			*w++ = table[v & 63];
+		}
+		if (i < size) {
+			const uint32_t v = (uint32_t(data[i]) << 16) | (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0);
+			*w++ = table[v >> 18];
+			*w++ = table[(v >> 12) & 63];
+			*w++ = i + 1 < size ? table[(v >> 6) & 63] : '=';
+			*w++ = '=';
+		}
+		*w++ = '"';
+		out.commit(w);
+	}
+
+} /* namespace detail */
+
+/*
+ * Steps stmt to the end and writes its rows as RFC 4180 CSV: columns are
+ * read straight from sqlite3_column_text/blob into out, integers are
+ * formatted without iostreams and reals come as SQLite renders them.
+ * NULL becomes an empty field. Returns the number of rows.
+ */
+inline std::size_t write_csv(statement& stmt, output_buffer& out, bool header = true, char delimiter = ',') {
+	const auto h = stmt.handle.get();
+	const int columns = sqlite3_column_count(h);
+	if (header) {
+		for (int i = 0; i < columns; ++i) {
+			if (i != 0) {
+				out.put(delimiter);
+			}
+			const auto name = sqlite3_column_name(h, i);
+			detail::write_csv_field(out, text_view{name, std::strlen(name)}, delimiter);
+		}
+		out.append("\r\n", 2);
+	}
+	std::size_t rows = 0;
+	while (stmt.step().has_data()) {
+		for (int i = 0; i < columns; ++i) {
+			if (i != 0) {
+				out.put(delimiter);
+			}
+			switch (sqlite3_column_type(h, i)) {
+				case SQLITE_NULL:
+					break;
+				case SQLITE_INTEGER:
+					detail::write_integer_column(out, h, i);
+					break;
+				case SQLITE_FLOAT: {
+					const auto text = detail::real_column_text(h, i);
+					out.append(text.data, text.size);
+					break;
+				}
+				default:
+					detail::write_csv_field(out, detail::raw_column_text(h, i), delimiter);
+			}
+		}
+		out.append("\r\n", 2);
+		++rows;
+	}
+	return rows;
+}
+
+/*
+ * Steps stmt to the end and writes one JSON object per row and line,
+ * keyed by column name. Blobs are base64 strings; infinite or NaN reals
+ * become null. Returns the number of rows.
+ */
+inline std::size_t write_jsonl(statement& stmt, output_buffer& out) {
+	const auto h = stmt.handle.get();
+	const int columns = sqlite3_column_count(h);
+	// the escaped "name": prefixes, built once
+	std::vector<std::string> keys;
+	{
+		std::string escaped;
+		output_buffer key_out = output_buffer::to_string(escaped, 256);
+		for (int i = 0; i < columns; ++i) {
+			const auto name = sqlite3_column_name(h, i);
+			key_out.put(i == 0 ? '{' : ',');
+			detail::write_json_string(key_out, name, std::strlen(name));
+			key_out.put(':');
+			key_out.flush();
+			keys.push_back(escaped);
+			escaped.clear();
+		}
+	}
+	std::size_t rows = 0;
+	while (stmt.step().has_data()) {
+		for (int i = 0; i < columns; ++i) {
+			out.append(keys[i]);
+			switch (sqlite3_column_type(h, i)) {
+				case SQLITE_NULL:
+					out.append("null", 4);
+					break;
+				case SQLITE_INTEGER:
+					detail::write_integer_column(out, h, i);
+					break;
+				case SQLITE_FLOAT:
+					if (std::isfinite(sqlite3_column_double(h, i))) {
+						const auto text = detail::real_column_text(h, i);
+						out.append(text.data, text.size);
+					} else {
+						out.append("null", 4);
+					}
+					break;
+				case SQLITE_BLOB:
+					detail::write_base64(out, static_cast<const unsigned char*>(sqlite3_column_blob(h, i)),
+							     static_cast<std::size_t>(sqlite3_column_bytes(h, i)));
+					break;
+				default: {
+					const auto text = detail::raw_column_text(h, i);
+					detail::write_json_string(out, text.data, text.size);
+				}
+			}
+		}
+		out.append(columns == 0 ? "{}\n" : "}\n", columns == 0 ? 3 : 2);
+		++rows;
+	}
+	return rows;
+}
+
+} /* namespace sqlite  */
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+// the Arrow C data interface, https://arrow.apache.org/docs/format/CDataInterface.html
+extern "C" {
+
+struct ArrowSchema {
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+	void (*release)(struct ArrowSchema*);
+	void* private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+	void (*release)(struct ArrowArray*);
+	void* private_data;
+};
+
+}
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+namespace sqlite {
+
+namespace detail {
+
+	enum arrow_type { ARROW_INT64, ARROW_DOUBLE, ARROW_UTF8, ARROW_BINARY };
+
+	// from the declared type, else from the current row's value
+	inline arrow_type arrow_column_type(sqlite3_stmt* stmt, int column) noexcept {
+		std::string decl = sqlite3_column_decltype(stmt, column) != nullptr ? sqlite3_column_decltype(stmt, column) : "";
+		for (auto& c : decl) {
+			c = static_cast<char>(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+		}
+		if (decl.find("INT") != std::string::npos) {
+			return ARROW_INT64;
+		}
+		if (decl.find("CHAR") != std::string::npos || decl.find("CLOB") != std::string::npos
+		    || decl.find("TEXT") != std::string::npos) {
+			return ARROW_UTF8;
+		}
+		if (decl.find("REAL") != std::string::npos || decl.find("FLOA") != std::string::npos
+		    || decl.find("DOUB") != std::string::npos) {
+			return ARROW_DOUBLE;
+		}
+		switch (sqlite3_column_type(stmt, column)) {
+			case SQLITE_INTEGER: return ARROW_INT64;
+			case SQLITE_FLOAT: return ARROW_DOUBLE;
+			case SQLITE_BLOB: return ARROW_BINARY;
+			default: return ARROW_UTF8;
+		}
+	}
+
+	// one column's buffers, owned by its ArrowArray
+	struct arrow_column {
+		arrow_type type;
+		std::vector<uint8_t> validity;
+		std::vector<int64_t> ints;
+		std::vector<double> reals;
+		std::vector<int32_t> offsets{0};
+		std::vector<char> bytes;
+		int64_t length = 0;
+		int64_t nulls = 0;
+		const void* buffers[3];
+
+		void append(sqlite3_stmt* stmt, int column) {
+			if ((length & 7) == 0) {
+				validity.push_back(0);
+			}
+			const bool null = sqlite3_column_type(stmt, column) == SQLITE_NULL;
+			if (null) {
+				++nulls;
+			} else {
+				validity.back() |= static_cast<uint8_t>(1u << (length & 7));
+			}
+			++length;
+			switch (type) {
+				case ARROW_INT64:
+					ints.push_back(null ? 0 : sqlite3_column_int64(stmt, column));
+					break;
+				case ARROW_DOUBLE:
+					reals.push_back(null ? 0.0 : sqlite3_column_double(stmt, column));
+					break;
+				default: {
+					if (!null) {
+						const auto data = static_cast<const char*>(type == ARROW_BINARY ? sqlite3_column_blob(stmt, column)
+													: sqlite3_column_text(stmt, column));
+						const auto size = static_cast<std::size_t>(sqlite3_column_bytes(stmt, column));
+						bytes.insert(bytes.end(), data, data + size);
+					}
+					offsets.push_back(static_cast<int32_t>(bytes.size()));
+				}
+			}
+		}
+
+		void export_to(ArrowArray* out) {
+			buffers[0] = nulls > 0 ? validity.data() : nullptr;
+			out->length = length;
+			out->null_count = nulls;
+			out->offset = 0;
+			out->n_children = 0;
+			out->children = nullptr;
+			out->dictionary = nullptr;
+			out->buffers = buffers;
+			if (type == ARROW_INT64 || type == ARROW_DOUBLE) {
+				buffers[1] = type == ARROW_INT64 ? static_cast<const void*>(ints.data()) : reals.data();
+				out->n_buffers = 2;
+			} else {
+				buffers[1] = offsets.data();
+				buffers[2] = bytes.data();
+				out->n_buffers = 3;
+			}
+			out->private_data = this;
+			out->release = &release;
+		}
+
+		static void release(ArrowArray* a) {
+			delete static_cast<arrow_column*>(a->private_data);
+			a->release = nullptr;
+		}
+	};
+
+	struct arrow_struct {
+		std::vector<ArrowArray> child_arrays;
+		std::vector<ArrowArray*> children;
+		const void* buffers[1] = {nullptr};
+
+		~arrow_struct() {
+			for (auto& c : child_arrays) {
+				if (c.release != nullptr) {
+					c.release(&c);
+				}
+			}
+		}
+
+		static void release(ArrowArray* a) {
+			delete static_cast<arrow_struct*>(a->private_data);
+			a->release = nullptr;
+		}
+	};
+
+	// a column's schema, which owns its strings so that it can be moved out and released on its own
+	struct arrow_field {
+		std::string name;
+		std::string format;
+
+		static void export_to(ArrowSchema* out, const char* name, const char* format) {
+			std::unique_ptr<arrow_field> self(new arrow_field());
+			self->name = name;
+			self->format = format;
+			*out = ArrowSchema();
+			out->format = self->format.c_str();
+			out->name = self->name.c_str();
+			out->flags = ARROW_FLAG_NULLABLE;
+			out->release = &release;
+			out->private_data = self.release();
+		}
+
+		static void release(ArrowSchema* s) {
+			delete static_cast<arrow_field*>(s->private_data);
+			s->release = nullptr;
+		}
+	};
+
+	struct arrow_schema {
+		std::vector<ArrowSchema> child_schemas;
+		std::vector<ArrowSchema*> children;
+
+		// children that were not moved out go with the parent
+		~arrow_schema() {
+			for (auto& c : child_schemas) {
+				if (c.release != nullptr) {
+					c.release(&c);
+				}
+			}
+		}
+
+		static void release(ArrowSchema* s) {
+			delete static_cast<arrow_schema*>(s->private_data);
+			s->release = nullptr;
+		}
+	};
+
+} /* namespace detail */
+
+/*
+ * Reads stmt as Arrow record batches of up to batch_rows rows, handed over
+ * through the C data interface (a struct array with one child per column,
+ * plus its schema), which pyarrow, DuckDB, Polars and others import
+ * without copying. Column types come from the declared type, else from the
+ * first row read: int64, float64, utf8 or binary. They are fixed for the
+ * whole export, so every batch has the same schema, and values of other
+ * types are converted by SQLite; batch_rows 0 reads everything into one
+ * batch. The caller owns what next() fills in and calls the release
+ * callbacks; every child can be moved out and released on its own.
+ *
+ *	arrow_reader reader(stmt, 65536);
+ *	ArrowArray batch;
+ *	ArrowSchema schema;
+ *	while (reader.next(&batch, &schema)) { ... }
+ */
+struct arrow_reader {
+
+	arrow_reader(statement& stmt, std::size_t batch_rows = 65536) : m_stmt(stmt), m_batch_rows(batch_rows) {}
+
+	// false once stmt is done; out_array and out_schema are then left alone
+	bool next(ArrowArray* out_array, ArrowSchema* out_schema) {
+		const auto h = m_stmt.handle.get();
+		if (m_done || !m_stmt.step().has_data()) {
+			m_done = true;
+			return false;
+		}
+		const int columns = sqlite3_column_count(h);
+		if (m_types.empty()) {
+			for (int i = 0; i < columns; ++i) {
+				m_types.push_back(detail::arrow_column_type(h, i));
+			}
+		}
+		std::vector<std::unique_ptr<detail::arrow_column>> data(static_cast<std::size_t>(columns));
+		for (int i = 0; i < columns; ++i) {
+			data[i].reset(new detail::arrow_column());
+			data[i]->type = m_types[i];
+		}
+		std::size_t rows = 0;
+		for (;;) {
+			for (int i = 0; i < columns; ++i) {
+				data[i]->append(h, i);
+			}
+			if (++rows == m_batch_rows) {
+				break;
+			}
+			// stepping past the end would start the statement over
+			if (!m_stmt.step().has_data()) {
+				m_done = true;
+				break;
+			}
+		}
+
+		static const char* const formats[] = {"l", "g", "u", "z"};
+		std::unique_ptr<detail::arrow_schema> schema(new detail::arrow_schema());
+		std::unique_ptr<detail::arrow_struct> batch(new detail::arrow_struct());
+		schema->child_schemas.resize(static_cast<std::size_t>(columns));
+		batch->child_arrays.resize(static_cast<std::size_t>(columns));
+		for (int i = 0; i < columns; ++i) {
+			auto& s = schema->child_schemas[i];
+			detail::arrow_field::export_to(&s, sqlite3_column_name(h, i), formats[m_types[i]]);
+			schema->children.push_back(&s);
+			data[i].release()->export_to(&batch->child_arrays[i]);
+			batch->children.push_back(&batch->child_arrays[i]);
+		}
+
+		*out_schema = ArrowSchema();
+		out_schema->format = "+s";
+		out_schema->name = "";
+		out_schema->n_children = columns;
+		out_schema->children = schema->children.data();
+		out_schema->release = &detail::arrow_schema::release;
+		out_schema->private_data = schema.release();
+
+		*out_array = ArrowArray();
+		out_array->length = static_cast<int64_t>(rows);
+		out_array->n_buffers = 1;
+		out_array->buffers = batch->buffers;
+		out_array->n_children = columns;
+		out_array->children = batch->children.data();
+		out_array->release = &detail::arrow_struct::release;
+		out_array->private_data = batch.release();
+		m_rows += rows;
+		return true;
+	}
+
+	// rows in the batches so far
+	inline std::size_t rows() const noexcept { return m_rows; }
+
+	private:
+	statement& m_stmt;
+	std::size_t m_batch_rows;
+	std::size_t m_rows = 0;
+	bool m_done = false;
+	std::vector<detail::arrow_type> m_types; // fixed by the first batch
+};
+
+} /* namespace sqlite  */
+
+#endif /* __EXPORT_HPP__ */
@@ -0,0 +1,585 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __INGEST_HPP__
+#define __INGEST_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace sqlite {
+
+struct ingest_options {
+	std::size_t batch_size = 100000;   // rows per transaction
+	std::size_t chunk_rows = 8192;     // rows the parser hands over at once
+	std::size_t chunks_in_flight = 4;  // parsed chunks buffered ahead of the inserts
+	bool pipelined = true;             // parse on a second thread
+	char delimiter = ',';
+	bool header = true;                // the first record names the columns
+	bool empty_is_null = false;        // unquoted empty fields bind NULL instead of ''
+};
+
+struct ingest_result {
+	std::size_t rows = 0;
+	std::size_t batches = 0; // transactions committed by the ingest itself
+};
+
+/*
+ * A read-only mapping of a whole file; empty files map to nothing. Files
+ * that cannot be mapped (pipes, some special files) are read instead.
+ */
+struct mapped_file {
+
+	explicit mapped_file(const std::string& path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw sql_error(SQLITE_CANTOPEN, "cannot open " + path);
+		}
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			m_size = static_cast<std::size_t>(st.st_size);
+			if (m_size > 0) {
+				void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					::madvise(p, m_size, MADV_SEQUENTIAL);
+					m_data = static_cast<const char*>(p);
+				}
+			}
+		}
+		if (m_data == nullptr && !read_all(fd)) {
+			::close(fd);
+			throw sql_error(SQLITE_IOERR, "cannot read " + path);
+		}
+		::close(fd);
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	~mapped_file() {
+		if (m_data != nullptr && m_copy.empty()) {
+			::munmap(const_cast<char*>(m_data), m_size);
+		}
+	}
+
+	inline const char* data() const noexcept { return m_data; }
+	inline std::size_t size() const noexcept { return m_size; }
+
+	private:
+	const char* m_data = nullptr;
+	std::size_t m_size = 0;
+	std::string m_copy;
+
+	bool read_all(int fd) {
+		char buffer[1 << 16];
+		for (;;) {
+			const auto n = ::read(fd, buffer, sizeof buffer);
+			if (n < 0) {
+				return false;
+			}
+			if (n == 0) {
+				break;
+			}
+			m_copy.append(buffer, static_cast<std::size_t>(n));
+		}
+		m_data = m_copy.data();
+		m_size = m_copy.size();
+		return true;
+	}
+};
+
+namespace detail {
+
+	// the first a or b in [p, end), or end; sixteen bytes per compare with SSE2
+	inline const char* scan_for(const char* p, const char* end, char a, char b) noexcept {
+#if defined(__SSE2__)
+		const __m128i va = _mm_set1_epi8(a);
+		const __m128i vb = _mm_set1_epi8(b);
+		while (end - p >= 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+			if (mask != 0) {
+				return p + __builtin_ctz(static_cast<unsigned>(mask));
+			}
+			p += 16;
+		}
+#endif
+		while (p < end && *p != a && *p != b) {
+			++p;
+		}
+		return p;
+	}
+
+	/*
+	 * Splits RFC 4180 records. Fields are views into the input; only
+	 * quoted fields with doubled quotes are copied (into arena). A NULL
+	 * field has data == nullptr.
+	 */
+	struct csv_reader {
+
+		csv_reader(const char* data, std::size_t size, char delimiter, bool empty_is_null) noexcept
+		: m_p(data), m_end(data + size), m_delimiter(delimiter), m_empty_is_null(empty_is_null) {}
+
+		/*
+		 * Appends the fields of the next record; false at the end of the
+		 * input. A blank line is a record of one empty field, except for
+		 * a final one right before the end, which only ends the last record.
+		 */
+		bool next(std::vector<text_view>& fields, std::deque<std::string>& arena) {
+			const auto rest = m_end - m_p;
+			if (rest == 0 || (rest == 1 && *m_p == '\n') || (rest == 2 && m_p[0] == '\r' && m_p[1] == '\n')) {
+				m_p = m_end;
+				return false;
+			}
+			m_record = m_line;
+			for (;;) {
+				fields.push_back(*m_p == '"' ? quoted(arena) : unquoted());
+				if (m_p == m_end) {
+					return true;
+				}
+				if (*m_p == m_delimiter) {
+					if (++m_p == m_end) {
+						fields.push_back(empty());
+						return true;
+					}
+					continue;
+				}
+				if (*m_p == '\r' && (m_p + 1 == m_end || m_p[1] == '\n')) {
+					if (++m_p == m_end) {
+						return true;
+					}
+				}
+				if (*m_p != '\n') {
+					throw error("unexpected character after a quoted field");
+				}
+				++m_p;
+				++m_line;
+				return true;
+			}
+		}
+
+		// where the last record started
+		inline std::size_t line() const noexcept { return m_record; }
+
+		sql_error error(const std::string& what) const {
+			return sql_error(SQLITE_MISMATCH, "csv line " + std::to_string(m_record) + ": " + what);
+		}
+
+		private:
+		const char* m_p;
+		const char* m_end;
+		char m_delimiter;
+		bool m_empty_is_null;
+		std::size_t m_line = 1;
+		std::size_t m_record = 1;
+
+		text_view empty() const noexcept {
+			return m_empty_is_null ? text_view{nullptr, 0} : text_view{m_p, 0};
+		}
+
+		text_view unquoted() noexcept {
+			const auto start = m_p;
+			m_p = scan_for(m_p, m_end, m_delimiter, '\n');
+			auto last = m_p;
+			if (last > start && last[-1] == '\r' && (m_p == m_end || *m_p == '\n')) {
+				--last;
+			}
+			if (last == start) {
+				return empty();
+			}
+			return text_view{start, static_cast<std::size_t>(last - start)};
+		}
+
+		text_view quoted(std::deque<std::string>& arena) {
+			const auto start = ++m_p;
+			auto segment = start;
+			std::string* copy = nullptr;
+			for (;;) {
+				const auto q = scan_for(segment, m_end, '"', '"');
+				m_line += static_cast<std::size_t>(std::count(segment, q, '\n'));
+				if (q == m_end) {
+					throw error("unterminated quoted field");
+				}
+				if (q + 1 < m_end && q[1] == '"') {
+					if (copy == nullptr) {
+						arena.emplace_back();
+						copy = &arena.back();
+					}
+					copy->append(segment, q + 1);
+					segment = q + 2;
+					continue;
+				}
+				m_p = q + 1;
+				if (copy == nullptr) {
+					return text_view{start, static_cast<std::size_t>(q - start)};
+				}
+				copy->append(segment, q);
+				return text_view{copy->data(), copy->size()};
+			}
+		}
+	};
+
+	struct csv_chunk {
+		std::vector<text_view> fields; // rows * columns
+		std::deque<std::string> arena;
+		std::size_t rows = 0;
+
+		void clear() {
+			fields.clear();
+			arena.clear();
+			rows = 0;
+		}
+	};
+
+	// the parser's chunks travel to the inserter and back through here
+	struct chunk_pipe {
+
+		explicit chunk_pipe(std::size_t depth) {
+			for (std::size_t i = 0; i < std::max<std::size_t>(depth, 2); ++i) {
+				m_storage.emplace_back(new csv_chunk());
+				m_free.push_back(m_storage.back().get());
+			}
+		}
+
+		// producer side; nullptr once the consumer gave up
+		csv_chunk* take_free() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this] { return !m_free.empty() || m_stopped; });
+			if (m_stopped) {
+				return nullptr;
+			}
+			const auto c = m_free.back();
+			m_free.pop_back();
+			return c;
+		}
+
+		void push_full(csv_chunk* c) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_full.push_back(c);
+			m_changed.notify_all();
+		}
+
+		void close(std::exception_ptr error) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+			m_error = error;
+			m_changed.notify_all();
+		}
+
+		// consumer side; nullptr at the end, rethrows a parse error
+		csv_chunk* take_full() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this] { return !m_full.empty() || m_closed; });
+			if (m_full.empty()) {
+				if (m_error != nullptr) {
+					std::rethrow_exception(m_error);
+				}
+				return nullptr;
+			}
+			const auto c = m_full.front();
+			m_full.pop_front();
+			return c;
+		}
+
+		void recycle(csv_chunk* c) {
+			c->clear();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.push_back(c);
+			m_changed.notify_all();
+		}
+
+		void stop() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+			m_changed.notify_all();
+		}
+
+		private:
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::vector<std::unique_ptr<csv_chunk>> m_storage;
+		std::vector<csv_chunk*> m_free;
+		std::deque<csv_chunk*> m_full;
+		std::exception_ptr m_error;
+		bool m_closed = false;
+		bool m_stopped = false;
+	};
+
+	// one prepared INSERT, stepped row by row and committed in batches
+	struct ingest_sink {
+
+		ingest_sink(connection& c, const std::string& table, const std::vector<std::string>& columns,
+			    const ingest_options& options)
+		: m_conn(c), m_batch_size(std::max<std::size_t>(options.batch_size, 1)),
+		  m_own_transactions(sqlite3_get_autocommit(c.handle.get()) != 0) {
+			std::string names;
+			std::string values;
+			for (const auto& name : columns) {
+				names += (names.empty() ? "" : ", ") + detail::quote_identifier(name);
+				values += values.empty() ? "?" : ", ?";
+			}
+			m_insert = statement::create(c, "INSERT INTO " + detail::quote_identifier(table) + " (" + names
+							    + ") VALUES (" + values + ")");
+		}
+
+		ingest_sink(const ingest_sink&) = delete;
+		ingest_sink& operator=(const ingest_sink&) = delete;
+
+		// an ingest that did not get to finish() loses its open batch
+		~ingest_sink() { rollback(); }
+
+		inline statement& insert() noexcept { return m_insert; }
+
+		// the row has been bound
+		void row_done() {
+			if (m_own_transactions && !m_open) {
+				detail::run_cached(m_conn, "BEGIN");
+				m_open = true;
+			}
+			const auto r = m_insert.try_step();
+			sqlite3_reset(m_insert.handle.get());
+			r.check();
+			++m_result.rows;
+			if (m_open && ++m_in_batch >= m_batch_size) {
+				commit();
+			}
+		}
+
+		ingest_result finish() {
+			commit();
+			return m_result;
+		}
+
+		private:
+		connection& m_conn;
+		statement m_insert;
+		std::size_t m_batch_size;
+		std::size_t m_in_batch = 0;
+		bool m_own_transactions;
+		bool m_open = false;
+		ingest_result m_result;
+
+		void commit() {
+			if (m_open) {
+				detail::run_cached(m_conn, "COMMIT");
+				m_open = false;
+				m_in_batch = 0;
+				++m_result.batches;
+			}
+		}
+
+		void rollback() noexcept {
+			if (m_open) {
+				detail::run_cached_noexcept(m_conn, "ROLLBACK");
+				m_open = false;
+			}
+		}
+	};
+
+	inline void bind_text_field(statement& s, int index, const text_view& f) {
+		(f.data == nullptr ? s.create_binding(index) : s.create_binding(index, f)).check();
+	}
+
+	inline void insert_chunk(ingest_sink& sink, const csv_chunk& chunk, std::size_t columns) {
+		auto& s = sink.insert();
+		auto f = chunk.fields.data();
+		for (std::size_t r = 0; r < chunk.rows; ++r) {
+			for (std::size_t c = 0; c < columns; ++c) {
+				bind_text_field(s, static_cast<int>(c + 1), *f++);
+			}
+			sink.row_done();
+		}
+	}
+
+	inline bool parse_chunk(csv_reader& reader, csv_chunk& chunk, std::size_t columns, std::size_t max_rows) {
+		while (chunk.rows < max_rows) {
+			const auto before = chunk.fields.size();
+			if (!reader.next(chunk.fields, chunk.arena)) {
+				return false;
+			}
+			if (chunk.fields.size() - before != columns) {
+				throw reader.error("expected " + std::to_string(columns) + " fields, got "
+						   + std::to_string(chunk.fields.size() - before));
+			}
+			++chunk.rows;
+		}
+		return true;
+	}
+
+} /* namespace detail */
+
+/*
+ * Loads CSV text into table. Fields are bound as text with SQLITE_STATIC
+ * straight out of the input, so column affinity does the conversions
+ * (declare INTEGER/REAL columns to store numbers).
+ *
+ * columns names the target columns in field order. When it is empty the
+ * header record supplies the names, or (without a header) the fields are
+ * taken positionally as c1, c2, ... which the table must then use. The
+ * table and column names are quoted, so a header is taken literally. With
+ * pipelined set, a second thread parses chunk_rows records at a time while
+ * the calling thread inserts; the parser never touches SQLite.
+ *
+ * Every batch_size rows are committed, unless the connection is already
+ * inside a transaction, which is then left to the caller. On an error the
+ * open batch is rolled back; earlier batches stay committed.
+ */
+inline ingest_result ingest_csv(connection& c, const char* data, std::size_t size, const std::string& table,
+				std::vector<std::string> columns = std::vector<std::string>(),
+				const ingest_options& options = ingest_options()) {
+	detail::csv_reader reader(data, size, options.delimiter, options.empty_is_null);
+	detail::csv_chunk first;
+	if (!reader.next(first.fields, first.arena)) {
+		return ingest_result();
+	}
+	first.rows = 1;
+	if (columns.empty()) {
+		for (std::size_t i = 0; i < first.fields.size(); ++i) {
+			const auto& f = first.fields[i];
+			columns.push_back(!options.header ? "c" + std::to_string(i + 1) : f.data != nullptr ? f.str() : std::string());
+		}
+	}
+	if (first.fields.size() != columns.size()) {
+		throw reader.error("expected " + std::to_string(columns.size()) + " fields");
+	}
+
+	detail::ingest_sink sink(c, table, columns, options);
+	const auto width = columns.size();
+	const auto chunk_rows = std::max<std::size_t>(options.chunk_rows, 1);
+	if (!options.header) {
+		detail::insert_chunk(sink, first, width);
+	}
+
+	if (!options.pipelined) {
+		detail::csv_chunk chunk;
+		bool more = true;
+		while (more) {
+			chunk.clear();
+			more = detail::parse_chunk(reader, chunk, width, chunk_rows);
+			detail::insert_chunk(sink, chunk, width);
+		}
+		return sink.finish();
+	}
+
+	detail::chunk_pipe pipe(options.chunks_in_flight);
+	std::thread parser([&pipe, &reader, width, chunk_rows] {
+		try {
+			bool more = true;
+			while (more) {
+				const auto chunk = pipe.take_free();
+				if (chunk == nullptr) {
+					break;
+				}
+				more = detail::parse_chunk(reader, *chunk, width, chunk_rows);
+				pipe.push_full(chunk);
+			}
+			pipe.close(nullptr);
+		} catch (...) {
+			pipe.close(std::current_exception());
+		}
+	});
+	try {
+		while (const auto chunk = pipe.take_full()) {
+			detail::insert_chunk(sink, *chunk, width);
+			pipe.recycle(chunk);
+		}
+	} catch (...) {
+		pipe.stop();
+		parser.join();
+		throw;
+	}
+	parser.join();
+	return sink.finish();
+}
+
+inline ingest_result ingest_csv(connection& c, const std::string& path, const std::string& table,
+				std::vector<std::string> columns = std::vector<std::string>(),
+				const ingest_options& options = ingest_options()) {
+	const mapped_file file(path);
+	return ingest_csv(c, file.data(), file.size(), table, std::move(columns), options);
+}
+
+/*
+ * One column of a caller-owned column-major buffer. Text is either an
+ * array of text_view or Arrow-style offsets (offsets[i]..offsets[i + 1]
+ * into data). valid, when set, holds one byte per row, zero for NULL.
+ * Nothing is copied: the buffers must stay put until the ingest returns.
+ */
+struct column_view {
+	enum kind { INT64, DOUBLE, TEXT, TEXT_OFFSETS };
+
+	kind type;
+	const void* values;
+	const int32_t* offsets;
+	const uint8_t* valid;
+
+	static inline column_view int64s(const int64_t* values, const uint8_t* valid = nullptr) {
+		return column_view{INT64, values, nullptr, valid};
+	}
+	static inline column_view doubles(const double* values, const uint8_t* valid = nullptr) {
+		return column_view{DOUBLE, values, nullptr, valid};
+	}
+	static inline column_view texts(const text_view* values, const uint8_t* valid = nullptr) {
+		return column_view{TEXT, values, nullptr, valid};
+	}
+	static inline column_view texts(const char* data, const int32_t* offsets, const uint8_t* valid = nullptr) {
+		return column_view{TEXT_OFFSETS, data, offsets, valid};
+	}
+};
+
+// inserts rows rows of the given columns, same batching rules as ingest_csv()
+inline ingest_result ingest_columns(connection& c, const std::string& table, const std::vector<std::string>& names,
+				    const std::vector<column_view>& columns, std::size_t rows,
+				    const ingest_options& options = ingest_options()) {
+	if (names.size() != columns.size()) {
+		throw sql_error(SQLITE_MISUSE, "ingest_columns: column names do not match the buffers");
+	}
+	detail::ingest_sink sink(c, table, names, options);
+	auto& s = sink.insert();
+	const auto h = s.handle.get();
+	for (std::size_t r = 0; r < rows; ++r) {
+		for (std::size_t i = 0; i < columns.size(); ++i) {
+			const auto& col = columns[i];
+			const int index = static_cast<int>(i + 1);
+			int rc;
+			if (col.valid != nullptr && col.valid[r] == 0) {
+				rc = sqlite3_bind_null(h, index);
+			} else if (col.type == column_view::INT64) {
+				rc = sqlite3_bind_int64(h, index, static_cast<const int64_t*>(col.values)[r]);
+			} else if (col.type == column_view::DOUBLE) {
+				rc = sqlite3_bind_double(h, index, static_cast<const double*>(col.values)[r]);
+			} else if (col.type == column_view::TEXT) {
+				const auto& t = static_cast<const text_view*>(col.values)[r];
+				rc = sqlite3_bind_text(h, index, t.data, static_cast<int>(t.size), SQLITE_STATIC);
+			} else {
+				const auto data = static_cast<const char*>(col.values);
+				rc = sqlite3_bind_text(h, index, data + col.offsets[r], col.offsets[r + 1] - col.offsets[r], SQLITE_STATIC);
+			}
+			sql_result::from_cmd(rc, s.handle).check();
+		}
+		sink.row_done();
+	}
+	return sink.finish();
+}
+
+} /* namespace sqlite  */
+
+#endif /* __INGEST_HPP__ */
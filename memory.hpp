@@ -0,0 +1,553 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __MEMORY_HPP__
+#define __MEMORY_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace sqlite {
+
+/*
+ * Process-wide memory hooks. sqlite3_config() only works before the library
+ * is initialized, so install these before the first connection is opened
+ * (or after sqlite3_shutdown()).
+ */
+inline sql_result install_allocator(const sqlite3_mem_methods& methods) {
+	return sql_result::from_cmd(sqlite3_config(SQLITE_CONFIG_MALLOC, &methods), static_cast<sqlite3*>(nullptr));
+}
+
+inline sql_result install_page_cache(const sqlite3_pcache_methods2& methods) {
+	return sql_result::from_cmd(sqlite3_config(SQLITE_CONFIG_PCACHE2, &methods), static_cast<sqlite3*>(nullptr));
+}
+
+/*
+ * sqlite3_mem_methods backed by size-class free lists. Small blocks come
+ * from 64 KiB chunks that are never given back to the system; each thread
+ * keeps a short free list per class and only takes the shared lock to
+ * refill or drain it. Requests above the largest class go to malloc.
+ */
+struct size_class_allocator {
+
+	static inline sql_result install() { return install_allocator(methods()); }
+
+	static const sqlite3_mem_methods& methods() {
+		static const sqlite3_mem_methods m = {
+			&size_class_allocator::x_malloc, &size_class_allocator::x_free, &size_class_allocator::x_realloc,
+			&size_class_allocator::x_size, &size_class_allocator::x_roundup,
+			&size_class_allocator::x_init, &size_class_allocator::x_shutdown, nullptr
+		};
+		return m;
+	}
+
+	// memory carved out for the size classes so far
+	static std::size_t bytes_reserved() {
+		auto& s = shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.reserved;
+	}
+
+	private:
+	static const std::size_t class_count = 16;
+	static const std::size_t chunk_size = 64 * 1024;
+	static const unsigned thread_cache_limit = 64;
+	static const unsigned refill_count = 32;
+
+	// header in front of every block, keeps the user pointer 16-byte aligned
+	struct header {
+		std::size_t size;  // usable bytes
+		std::size_t index; // size class, class_count for plain malloc
+	};
+
+	struct block {
+		block* next;
+	};
+
+	struct shared_state {
+		std::mutex mutex;
+		block* free[class_count] = {};
+		std::size_t reserved = 0;
+	};
+
+	struct thread_cache {
+		block* free[class_count] = {};
+		unsigned count[class_count] = {};
+
+		~thread_cache() {
+			for (std::size_t i = 0; i < class_count; ++i) {
+				while (free[i] != nullptr) {
+					auto b = free[i];
+					free[i] = b->next;
+					give_back(i, b);
+				}
+			}
+		}
+	};
+
+	static inline std::size_t class_size(std::size_t index) noexcept {
+		static const std::size_t sizes[class_count] = {
+			16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+		};
+		return sizes[index];
+	}
+
+	static inline std::size_t class_of(std::size_t n) noexcept {
+		std::size_t i = 0;
+		while (i < class_count && class_size(i) < n) {
+			++i;
+		}
+		return i;
+	}
+
+	static shared_state& shared() {
+		static shared_state s;
+		return s;
+	}
+
+	static thread_cache& local() {
+		static thread_local thread_cache c;
+		return c;
+	}
+
+	static void give_back(std::size_t index, block* b) {
+		auto& s = shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		b->next = s.free[index];
+		s.free[index] = b;
+	}
+
+	// moves up to refill_count blocks of a class into the thread cache
+	static bool refill(thread_cache& c, std::size_t index) {
+		auto& s = shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.free[index] == nullptr) {
+			const auto stride = sizeof(header) + class_size(index);
+			const auto chunk = static_cast<char*>(std::malloc(chunk_size));
+			if (chunk == nullptr) {
+				return false;
+			}
+			s.reserved += chunk_size;
+			for (std::size_t offset = 0; offset + stride <= chunk_size; offset += stride) {
+				const auto h = reinterpret_cast<header*>(chunk + offset);
+				h->size = class_size(index);
+				h->index = index;
+				const auto b = reinterpret_cast<block*>(h + 1);
+				b->next = s.free[index];
+				s.free[index] = b;
+			}
+		}
+		for (unsigned i = 0; i < refill_count && s.free[index] != nullptr; ++i) {
+			const auto b = s.free[index];
+			s.free[index] = b->next;
+			b->next = c.free[index];
+			c.free[index] = b;
+			++c.count[index];
+		}
+		return true;
+	}
+
+	static inline header* header_of(void* p) noexcept { return static_cast<header*>(p) - 1; }
+
+	static void* x_malloc(int n) {
+		const auto size = static_cast<std::size_t>(std::max(n, 1));
+		const auto index = class_of(size);
+		if (index == class_count) {
+			const auto h = static_cast<header*>(std::malloc(sizeof(header) + size));
+			if (h == nullptr) {
+				return nullptr;
+			}
+			h->size = size;
+			h->index = class_count;
+			return h + 1;
+		}
+		auto& c = local();
+		if (c.free[index] == nullptr && !refill(c, index)) {
+			return nullptr;
+		}
+		const auto b = c.free[index];
+		c.free[index] = b->next;
+		--c.count[index];
+		return b;
+	}
+
+	static void x_free(void* p) {
+		const auto h = header_of(p);
+		if (h->index == class_count) {
+			std::free(h);
+			return;
+		}
+		auto& c = local();
+		if (c.count[h->index] >= thread_cache_limit) {
+			give_back(h->index, static_cast<block*>(p));
+			return;
+		}
+		const auto b = static_cast<block*>(p);
+		b->next = c.free[h->index];
+		c.free[h->index] = b;
+		++c.count[h->index];
+	}
+
+	static void* x_realloc(void* p, int n) {
+		const auto h = header_of(p);
+		const auto size = static_cast<std::size_t>(std::max(n, 1));
+		if (h->index != class_count && class_of(size) == h->index) {
+			return p;
+		}
+		const auto result = x_malloc(n);
+		if (result != nullptr) {
+			std::memcpy(result, p, std::min(size, h->size));
+			x_free(p);
+		}
+		return result;
+	}
+
+	static int x_size(void* p) { return static_cast<int>(header_of(p)->size); }
+
+	static int x_roundup(int n) {
+		const auto index = class_of(static_cast<std::size_t>(std::max(n, 1)));
+		return index == class_count ? ((n + 7) & ~7) : static_cast<int>(class_size(index));
+	}
+
+	static int x_init(void*) { return SQLITE_OK; }
+	static void x_shutdown(void*) {}
+};
+
+/*
+ * sqlite3_pcache_methods2 that keeps pages in one preallocated slab. The
+ * slab is reserved up front (mmap'd and advised for transparent huge pages
+ * where available) and touched by the installing thread, so it is local
+ * to that thread's NUMA node. Page cache memory therefore never exceeds the
+ * slab: a file-backed cache that runs out of slots recycles its own least
+ * recently used pages instead. Only when that fails and SQLite insists
+ * (createFlag 2), or for in-memory databases which cannot drop pages, does
+ * a page fall back to malloc; heap_pages() counts those.
+ */
+struct slab_page_cache {
+
+	// slots are sized for max_page_size plus SQLite's per-page extra (< 250 bytes)
+	static sql_result install(std::size_t slab_bytes, std::size_t max_page_size = 4096) {
+		auto& s = slab();
+		s.slot_size = (sizeof(entry) + max_page_size + 256 + 63) & ~std::size_t(63);
+		s.slot_count = slab_bytes / s.slot_size;
+		s.base = static_cast<char*>(reserve(s.slot_count * s.slot_size));
+		if (s.base == nullptr) {
+			s.slot_count = 0;
+			return sql_result::from_cmd(SQLITE_NOMEM, static_cast<sqlite3*>(nullptr));
+		}
+		s.free.reserve(s.slot_count);
+		for (std::size_t i = s.slot_count; i > 0; --i) {
+			s.free.push_back(static_cast<unsigned>(i - 1));
+		}
+		return install_page_cache(methods());
+	}
+
+	static const sqlite3_pcache_methods2& methods() {
+		static const sqlite3_pcache_methods2 m = {
+			1, nullptr, &slab_page_cache::x_init, &slab_page_cache::x_shutdown, &slab_page_cache::x_create,
+			&slab_page_cache::x_cachesize, &slab_page_cache::x_pagecount, &slab_page_cache::x_fetch,
+			&slab_page_cache::x_unpin, &slab_page_cache::x_rekey, &slab_page_cache::x_truncate,
+			&slab_page_cache::x_destroy, &slab_page_cache::x_shrink
+		};
+		return m;
+	}
+
+	static std::size_t slots_total() noexcept { return slab().slot_count; }
+
+	static std::size_t slots_free() {
+		auto& s = slab();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.free.size();
+	}
+
+	// pages that did not fit into the slab and went to malloc
+	static std::size_t heap_pages() {
+		auto& s = slab();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.heap_pages;
+	}
+
+	private:
+	struct entry {
+		sqlite3_pcache_page page; // first, so sqlite3_pcache_page* is an entry*
+		unsigned key;
+		bool pinned;
+		bool from_slab;
+		entry* prev; // unpinned pages only
+		entry* next;
+	};
+
+	struct cache {
+		int page_size;
+		int extra_size;
+		bool purgeable;
+		unsigned max_pages = 100;
+		unsigned pinned = 0;
+		std::unordered_map<unsigned, entry*> pages;
+		entry lru; // sentinel, most recently unpinned after it
+
+		cache() {
+			lru.prev = lru.next = &lru;
+		}
+	};
+
+	struct slab_state {
+		std::mutex mutex;
+		char* base = nullptr;
+		std::size_t slot_size = 0;
+		std::size_t slot_count = 0;
+		std::size_t heap_pages = 0;
+		std::vector<unsigned> free;
+	};
+
+	static slab_state& slab() {
+		static slab_state s;
+		return s;
+	}
+
+	static void* reserve(std::size_t bytes) {
+		if (bytes == 0) {
+			return nullptr;
+		}
+#if defined(__unix__) || defined(__APPLE__)
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (p == MAP_FAILED) {
+			return nullptr;
+		}
+#ifdef MADV_HUGEPAGE
+		madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+#else
+		void* p = std::malloc(bytes);
+		if (p == nullptr) {
+			return nullptr;
+		}
+#endif
+		std::memset(p, 0, bytes); // first touch places the pages on this node
+		return p;
+	}
+
+	static entry* allocate(cache& c, bool try_hard) {
+		const auto bytes = sizeof(entry) + c.page_size + c.extra_size;
+		auto& s = slab();
+		char* memory = nullptr;
+		bool from_slab = false;
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (bytes <= s.slot_size && !s.free.empty()) {
+				memory = s.base + s.free.back() * s.slot_size;
+				s.free.pop_back();
+				from_slab = true;
+			} else if (!c.purgeable || try_hard || bytes > s.slot_size) {
+				++s.heap_pages;
+			} else {
+				return nullptr;
+			}
+		}
+		if (memory == nullptr) {
+			memory = static_cast<char*>(std::malloc(bytes));
+			if (memory == nullptr) {
+				std::lock_guard<std::mutex> lock(s.mutex);
+				--s.heap_pages;
+				return nullptr;
+			}
+		}
+		const auto e = reinterpret_cast<entry*>(memory);
+		e->page.pBuf = memory + sizeof(entry);
+		e->page.pExtra = memory + sizeof(entry) + c.page_size;
+		e->from_slab = from_slab;
+		return e;
+	}
+
+	static void release(entry* e) {
+		auto& s = slab();
+		if (e->from_slab) {
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.free.push_back(static_cast<unsigned>((reinterpret_cast<char*>(e) - s.base) / s.slot_size));
+		} else {
+			{
+				std::lock_guard<std::mutex> lock(s.mutex);
+				--s.heap_pages;
+			}
+			std::free(e);
+		}
+	}
+
+	static inline void unlink(entry* e) noexcept {
+		e->prev->next = e->next;
+		e->next->prev = e->prev;
+	}
+
+	static inline void link_front(cache& c, entry* e) noexcept {
+		e->next = c.lru.next;
+		e->prev = &c.lru;
+		c.lru.next->prev = e;
+		c.lru.next = e;
+	}
+
+	// takes the least recently used unpinned page out of the cache
+	static entry* recycle(cache& c) {
+		const auto e = c.lru.prev;
+		if (e == &c.lru) {
+			return nullptr;
+		}
+		unlink(e);
+		c.pages.erase(e->key);
+		return e;
+	}
+
+	static void evict_to(cache& c, std::size_t limit) {
+		while (c.pages.size() > limit) {
+			const auto e = recycle(c);
+			if (e == nullptr) {
+				break;
+			}
+			release(e);
+		}
+	}
+
+	static void discard(cache& c, entry* e) {
+		if (e->pinned) {
+			--c.pinned;
+		} else {
+			unlink(e);
+		}
+		c.pages.erase(e->key);
+		release(e);
+	}
+
+	static inline cache& self(sqlite3_pcache* p) noexcept { return *reinterpret_cast<cache*>(p); }
+
+	static int x_init(void*) { return SQLITE_OK; }
+	static void x_shutdown(void*) {}
+
+	static sqlite3_pcache* x_create(int page_size, int extra_size, int purgeable) {
+		cache* c = new (std::nothrow) cache();
+		if (c == nullptr) {
+			return nullptr;
+		}
+		c->page_size = page_size;
+		c->extra_size = extra_size;
+		c->purgeable = purgeable != 0;
+		return reinterpret_cast<sqlite3_pcache*>(c);
+	}
+
+	static void x_cachesize(sqlite3_pcache* p, int n) {
+		auto& c = self(p);
+		c.max_pages = static_cast<unsigned>(std::max(n, 1));
+		if (c.purgeable) {
+			evict_to(c, c.max_pages);
+		}
+	}
+
+	static int x_pagecount(sqlite3_pcache* p) { return static_cast<int>(self(p).pages.size()); }
+
+	static sqlite3_pcache_page* x_fetch(sqlite3_pcache* p, unsigned key, int create) {
+		auto& c = self(p);
+		const auto it = c.pages.find(key);
+		if (it != c.pages.end()) {
+			const auto e = it->second;
+			if (!e->pinned) {
+				unlink(e);
+				e->pinned = true;
+				++c.pinned;
+			}
+			return &e->page;
+		}
+		if (create == 0 || (create == 1 && c.purgeable && c.pinned >= c.max_pages)) {
+			return nullptr;
+		}
+
+		entry* e = nullptr;
+		if (c.purgeable && c.pages.size() >= c.max_pages) {
+			e = recycle(c);
+		}
+		if (e == nullptr) {
+			e = allocate(c, false);
+		}
+		if (e == nullptr) {
+			e = recycle(c);
+		}
+		if (e == nullptr && create == 2) {
+			e = allocate(c, true);
+		}
+		if (e == nullptr) {
+			return nullptr;
+		}
+		try {
+			c.pages.emplace(key, e);
+		} catch (...) {
+			release(e);
+			return nullptr;
+		}
+		e->key = key;
+		e->pinned = true;
+		++c.pinned;
+		std::memset(e->page.pExtra, 0, c.extra_size);
+		return &e->page;
+	}
+
+	static void x_unpin(sqlite3_pcache* p, sqlite3_pcache_page* page, int discard_page) {
+		auto& c = self(p);
+		const auto e = reinterpret_cast<entry*>(page);
+		if (discard_page != 0 || !c.purgeable || c.pages.size() > c.max_pages) {
+			discard(c, e);
+			return;
+		}
+		e->pinned = false;
+		--c.pinned;
+		link_front(c, e);
+	}
+
+	static void x_rekey(sqlite3_pcache* p, sqlite3_pcache_page* page, unsigned old_key, unsigned new_key) {
+		auto& c = self(p);
+		const auto e = reinterpret_cast<entry*>(page);
+		const auto it = c.pages.find(new_key);
+		if (it != c.pages.end() && it->second != e) {
+			discard(c, it->second);
+		}
+		c.pages.erase(old_key);
+		e->key = new_key;
+		c.pages[new_key] = e;
+	}
+
+	static void x_truncate(sqlite3_pcache* p, unsigned limit) {
+		auto& c = self(p);
+		std::vector<entry*> doomed;
+		for (const auto& kv : c.pages) {
+			if (kv.first >= limit) {
+				doomed.push_back(kv.second);
+			}
+		}
+		for (const auto e : doomed) {
+			discard(c, e);
+		}
+	}
+
+	static void x_destroy(sqlite3_pcache* p) {
+		auto& c = self(p);
+		for (const auto& kv : c.pages) {
+			release(kv.second);
+		}
+		delete &c;
+	}
+
+	static void x_shrink(sqlite3_pcache* p) {
+		evict_to(self(p), 0);
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __MEMORY_HPP__ */
@@ -0,0 +1,201 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __PARALLEL_SCAN_HPP__
+#define __PARALLEL_SCAN_HPP__
+
+#include "connection_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sqlite {
+
+// keys lower..upper, both inclusive
+struct scan_partition {
+	std::size_t index;
+	int64_t lower;
+	int64_t upper;
+};
+
+namespace detail {
+
+	/*
+	 * Runs scan(partition, statement&) for every partition on up to
+	 * pool.size() threads, each with its own lease. The first exception
+	 * stops the remaining partitions and is rethrown here.
+	 */
+	template<typename F>
+	void run_partitions(connection_pool& pool, const std::string& sql, const std::vector<scan_partition>& partitions, F& scan) {
+		std::atomic<std::size_t> next{0};
+		std::atomic<bool> failed{false};
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		auto worker = [&] {
+			try {
+				auto lease = pool.acquire();
+				for (auto i = next++; i < partitions.size() && !failed; i = next++) {
+					auto stmt = lease->prepare_cached(sql);
+					stmt.bind(1, partitions[i].lower).bind(2, partitions[i].upper);
+					scan(partitions[i], stmt);
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+				failed = true;
+			}
+		};
+		const auto threads = std::min(pool.size(), partitions.size());
+		std::vector<std::thread> workers;
+		for (std::size_t i = 1; i < threads; ++i) {
+			workers.emplace_back(worker);
+		}
+		if (threads > 0) {
+			worker(); // the calling thread takes a share too
+		}
+		for (auto& t : workers) {
+			t.join();
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+} /* namespace detail */
+
+/*
+ * Splits min(key)..max(key) of table into up to count ranges of equal
+ * width. Both ends come from the rowid or index b-tree, so this is two
+ * seeks, not a scan; heavily skewed keys give uneven partitions. key must
+ * be an integer column (rowid by default) and is used as written.
+ */
+inline std::vector<scan_partition> key_partitions(connection& c, const std::string& table, std::size_t count,
+						   const std::string& key = "rowid") {
+	std::vector<scan_partition> result;
+	auto bounds = statement::create(c, ("SELECT min(" + key + "), max(" + key + ") FROM "
+					    + detail::quote_identifier(table)).c_str());
+	if (!bounds.step().has_data() || sqlite3_column_type(bounds.handle.get(), 0) == SQLITE_NULL) {
+		return result;
+	}
+	const int64_t lower = bounds.get_int64(0);
+	const int64_t upper = bounds.get_int64(1);
+	// as unsigned, the width cannot overflow
+	const uint64_t span = static_cast<uint64_t>(upper) - static_cast<uint64_t>(lower);
+	const uint64_t keys = span == UINT64_MAX ? span : span + 1;
+	count = static_cast<std::size_t>(std::max<uint64_t>(1, std::min<uint64_t>(count, keys)));
+	const uint64_t width = keys / count;
+	const uint64_t wider = keys % count; // the first partitions get one key more
+	uint64_t start = static_cast<uint64_t>(lower);
+	for (std::size_t i = 0; i < count; ++i) {
+		const uint64_t end = i + 1 == count ? static_cast<uint64_t>(upper) : start + width - 1 + (i < wider ? 1 : 0);
+		result.push_back(scan_partition{i, static_cast<int64_t>(start), static_cast<int64_t>(end)});
+		start = end + 1;
+	}
+	return result;
+}
+
+/*
+ * Runs sql once per partition, in parallel over the pool's connections
+ * (read-only ones, e.g. database::readers(), under WAL), with the
+ * partition's bounds bound to ?1 and ?2:
+ *
+ *	auto parts = key_partitions(c, "events", pool.size() * 4);
+ *	parallel_scan(pool, "SELECT sum(bytes) FROM events WHERE rowid BETWEEN ?1 AND ?2", parts,
+ *		      [&](const scan_partition& p, statement& s) { s.step(); sums[p.index] = s.get_int64(0); });
+ *
+ * f(const scan_partition&, statement&) is called on a worker thread (the
+ * calling thread is one of them) with the statement bound but not
+ * stepped, so it must be safe to call concurrently. Each partition is its
+ * own read transaction; partitions don't see one consistent snapshot
+ * unless nothing writes meanwhile. Blocks until all partitions are done.
+ */
+template<typename F>
+void parallel_scan(connection_pool& pool, const std::string& sql, const std::vector<scan_partition>& partitions, F f) {
+	detail::run_partitions(pool, sql, partitions, f);
+}
+
+/*
+ * Like parallel_scan, but rows come back to the calling thread in
+ * partition order: read(statement&) turns the current row into a T on
+ * the worker, and sink(T&&) receives every row of partition 0, then of
+ * partition 1 and so on, each as soon as that partition is complete. With
+ * ORDER BY key in sql this is the same order a single scan would give.
+ * Rows of finished partitions wait in memory until their turn. Returns the
+ * number of rows.
+ */
+template<typename T, typename Read, typename Sink>
+std::size_t parallel_scan_ordered(connection_pool& pool, const std::string& sql, const std::vector<scan_partition>& partitions,
+				  Read read, Sink sink) {
+	std::vector<std::vector<T>> rows(partitions.size());
+	std::vector<char> complete(partitions.size(), 0);
+	std::mutex mutex;
+	std::condition_variable ready;
+	bool finished = false;
+	std::exception_ptr error;
+
+	std::thread scanner([&] {
+		auto scan = [&](const scan_partition& p, statement& stmt) {
+			std::vector<T> out;
+			while (stmt.step().has_data()) {
+				out.push_back(read(stmt));
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				rows[p.index] = std::move(out);
+				complete[p.index] = 1;
+			}
+			ready.notify_one();
+		};
+		try {
+			detail::run_partitions(pool, sql, partitions, scan);
+		} catch (...) {
+			error = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = true;
+		}
+		ready.notify_one();
+	});
+
+	std::size_t count = 0;
+	try {
+		for (std::size_t i = 0; i < partitions.size(); ++i) {
+			std::vector<T> batch;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [&] { return complete[i] != 0 || finished; });
+				if (complete[i] == 0) {
+					break; // the scan failed before this partition
+				}
+				batch = std::move(rows[i]);
+			}
+			for (auto& row : batch) {
+				sink(std::move(row));
+			}
+			count += batch.size();
+		}
+	} catch (...) {
+		scanner.join();
+		throw;
+	}
+	scanner.join();
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	return count;
+}
+
+} /* namespace sqlite  */
+
+#endif /* __PARALLEL_SCAN_HPP__ */
@@ -0,0 +1,315 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __PROFILE_HPP__
+#define __PROFILE_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sqlite {
+
+// everything recorded for one SQL text
+struct statement_profile {
+	std::string sql;
+	uint64_t runs = 0;         // completed runs reported by sqlite3_profile
+	uint64_t run_ns = 0;       // wall time of those runs
+	uint64_t max_run_ns = 0;
+	uint64_t steps = 0;        // steps seen by profiled_statement
+	uint64_t rows = 0;
+	uint64_t step_ns = 0;
+	uint64_t max_step_ns = 0;
+	uint64_t fullscan_steps = 0;
+	uint64_t sorts = 0;
+	uint64_t autoindexes = 0;
+	uint64_t vm_steps = 0;
+};
+
+/*
+ * Aggregates per-statement timings and sqlite3_stmt_status counters by SQL
+ * text, across any number of connections.
+ *
+ * attach() hooks sqlite3_profile on a connection, which covers every
+ * statement that runs there: each completed run adds its wall time and
+ * the FULLSCAN_STEP/SORT/AUTOINDEX/VM_STEP counters (which are reset for
+ * the next run); SQLite measures runs in whole milliseconds.
+ * profiled_statement adds per-step times and row counts.
+ *
+ * Runs slower than slow_threshold have their EXPLAIN QUERY PLAN passed to
+ * the slow log, once per SQL text. SQLite forbids using the connection
+ * from inside the profile callback, so the plan is fetched by
+ * explain_slow(); profiled_statement calls it after every finished run.
+ * The registry must outlive the connections it is attached to, or be
+ * detach()ed first.
+ */
+struct profile_registry {
+
+	using slow_log = std::function<void(const std::string& sql, uint64_t run_ns, const std::string& plan)>;
+
+	profile_registry() = default;
+
+	profile_registry(std::chrono::nanoseconds slow_threshold, slow_log log)
+	: m_slow_ns(static_cast<uint64_t>(slow_threshold.count())), m_log(std::move(log)) {}
+
+	profile_registry(const profile_registry&) = delete;
+	profile_registry& operator=(const profile_registry&) = delete;
+
+	void attach(const connection& c) {
+		const auto db = c.handle.get();
+		std::unique_ptr<hook> h(new hook{this, db});
+		sqlite3_profile(db, &profile_registry::on_profile, h.get());
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hooks[db] = std::move(h);
+	}
+
+	void detach(const connection& c) {
+		const auto db = c.handle.get();
+		sqlite3_profile(db, nullptr, nullptr);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hooks.erase(db);
+		m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(),
+					       [db](const slow_run& s) { return s.db == db; }),
+				m_pending.end());
+	}
+
+	// the entry for sql; it stays valid for the lifetime of the registry
+	statement_profile* entry(const char* sql) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return &lookup(sql);
+	}
+
+	void record_step(statement_profile* e, uint64_t ns, bool row) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++e->steps;
+		e->rows += row ? 1 : 0;
+		e->step_ns += ns;
+		e->max_step_ns = std::max(e->max_step_ns, ns);
+	}
+
+	// runs EXPLAIN QUERY PLAN for the slow statements seen so far on c
+	void explain_slow(const connection& c) { explain_slow(c.handle.get()); }
+
+	void explain_slow(sqlite3* db) {
+		std::vector<slow_run> pending;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_pending.empty()) {
+				return;
+			}
+			const auto other = std::partition(m_pending.begin(), m_pending.end(),
+							  [db](const slow_run& s) { return s.db != db; });
+			pending.assign(other, m_pending.end());
+			m_pending.erase(other, m_pending.end());
+		}
+		for (const auto& p : pending) {
+			std::string plan;
+			const auto sql = "EXPLAIN QUERY PLAN " + p.sql;
+			statement explain;
+			if (sqlite3_prepare_v2(db, sql.c_str(), sql.size(), explain.handle.get_address_of(), nullptr) == SQLITE_OK) {
+				while (explain.try_step().has_data()) {
+					plan += explain.get_string(3);
+					plan += '\n';
+				}
+			}
+			if (m_log) {
+				m_log(p.sql, p.ns, plan);
+			}
+		}
+	}
+
+	std::vector<statement_profile> snapshot() const {
+		std::vector<statement_profile> result;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			result.reserve(m_entries.size());
+			for (const auto& kv : m_entries) {
+				result.push_back(kv.second);
+			}
+		}
+		std::sort(result.begin(), result.end(), [](const statement_profile& a, const statement_profile& b) {
+			return a.run_ns + a.step_ns > b.run_ns + b.step_ns;
+		});
+		return result;
+	}
+
+	// zeroes all counters; entry pointers stay valid
+	void reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& kv : m_entries) {
+			auto sql = std::move(kv.second.sql);
+			kv.second = statement_profile();
+			kv.second.sql = std::move(sql);
+		}
+		m_explained.clear();
+	}
+
+	// human readable, most expensive statement first
+	void dump(std::ostream& out) const {
+		for (const auto& p : snapshot()) {
+			out << p.sql << "\n"
+			    << "  runs " << p.runs << ", " << p.run_ns / 1000 << " us total, " << p.max_run_ns / 1000 << " us max\n"
+			    << "  steps " << p.steps << ", rows " << p.rows << ", " << p.step_ns / 1000 << " us total\n"
+			    << "  fullscan " << p.fullscan_steps << ", sort " << p.sorts << ", autoindex " << p.autoindexes
+			    << ", vm " << p.vm_steps << "\n";
+		}
+	}
+
+	// Prometheus text exposition format
+	void write_metrics(std::ostream& out, const std::string& prefix = "sqlite_statement") const {
+		const auto list = snapshot();
+		const struct {
+			const char* name;
+			uint64_t statement_profile::*field;
+		} metrics[] = {
+			{"runs_total", &statement_profile::runs},
+			{"run_nanoseconds_total", &statement_profile::run_ns},
+			{"steps_total", &statement_profile::steps},
+			{"rows_total", &statement_profile::rows},
+			{"step_nanoseconds_total", &statement_profile::step_ns},
+			{"fullscan_steps_total", &statement_profile::fullscan_steps},
+			{"sorts_total", &statement_profile::sorts},
+			{"autoindexes_total", &statement_profile::autoindexes},
+			{"vm_steps_total", &statement_profile::vm_steps},
+		};
+		for (const auto& m : metrics) {
+			out << "# TYPE " << prefix << "_" << m.name << " counter\n";
+			for (const auto& p : list) {
+				out << prefix << "_" << m.name << "{sql=\"" << escape(p.sql) << "\"} " << p.*m.field << "\n";
+			}
+		}
+	}
+
+	private:
+	struct hook {
+		profile_registry* registry;
+		sqlite3* db;
+	};
+
+	struct slow_run {
+		std::string sql;
+		uint64_t ns;
+		sqlite3* db;
+	};
+
+	uint64_t m_slow_ns = 0; // 0 disables the slow log
+	slow_log m_log;
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::string, statement_profile> m_entries;
+	std::unordered_map<std::string, bool> m_explained;
+	std::vector<slow_run> m_pending;
+	std::unordered_map<sqlite3*, std::unique_ptr<hook>> m_hooks;
+
+	statement_profile& lookup(const char* sql) {
+		auto& e = m_entries[sql];
+		if (e.sql.empty()) {
+			e.sql = sql;
+		}
+		return e;
+	}
+
+	static std::string escape(const std::string& s) {
+		std::string result;
+		result.reserve(s.size());
+		for (const char ch : s) {
+			if (ch == '\\' || ch == '"') {
+				result += '\\';
+				result += ch;
+			} else if (ch == '\n') {
+				result += "\\n";
+			} else {
+				result += ch;
+			}
+		}
+		return result;
+	}
+
+	// the profile callback gets sqlite3_sql() of the statement that just ran
+	static sqlite3_stmt* find_statement(sqlite3* db, const char* sql) {
+		for (auto s = sqlite3_next_stmt(db, nullptr); s != nullptr; s = sqlite3_next_stmt(db, s)) {
+			if (sqlite3_sql(s) == sql) {
+				return s;
+			}
+		}
+		return nullptr;
+	}
+
+	static void on_profile(void* arg, const char* sql, sqlite3_uint64 ns) {
+		const auto h = static_cast<hook*>(arg);
+		auto& r = *h->registry;
+		uint64_t counters[4] = {0, 0, 0, 0};
+		if (const auto stmt = find_statement(h->db, sql)) {
+			counters[0] = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+			counters[1] = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+			counters[2] = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+			counters[3] = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+		}
+		std::lock_guard<std::mutex> lock(r.m_mutex);
+		auto& e = r.lookup(sql);
+		++e.runs;
+		e.run_ns += ns;
+		e.max_run_ns = std::max<uint64_t>(e.max_run_ns, ns);
+		e.fullscan_steps += counters[0];
+		e.sorts += counters[1];
+		e.autoindexes += counters[2];
+		e.vm_steps += counters[3];
+		if (r.m_slow_ns != 0 && ns >= r.m_slow_ns && e.sql.compare(0, 7, "EXPLAIN") != 0 && !r.m_explained[e.sql]) {
+			r.m_explained[e.sql] = true;
+			r.m_pending.push_back(slow_run{e.sql, ns, h->db});
+		}
+	}
+};
+
+/*
+ * A statement that adds the wall time of every step() and the rows it
+ * returned to a profile_registry. Like cached_statement it hides step();
+ * code that takes a plain statement& (rows(), typed_statement) steps it
+ * unprofiled, but is still covered by profile_registry::attach().
+ */
+struct profiled_statement : statement {
+
+	template<typename Connection>
+	static inline profiled_statement create(Connection&& c, std::string sql, profile_registry& registry) {
+		profiled_statement result;
+		result.prepare(std::forward<Connection>(c), std::move(sql)).check();
+		result.m_registry = &registry;
+		result.m_profile = registry.entry(sqlite3_sql(result.handle.get()));
+		return result;
+	}
+
+	inline sql_result step() const {
+		return try_step().check();
+	}
+
+	inline sql_result try_step() const {
+		const auto start = std::chrono::steady_clock::now();
+		const auto r = statement::try_step();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		if (m_registry != nullptr) {
+			const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+			m_registry->record_step(m_profile, static_cast<uint64_t>(ns), r.has_data());
+			if (!r.has_data()) {
+				// sqlite3_profile has seen the run by now
+				m_registry->explain_slow(sqlite3_db_handle(handle.get()));
+			}
+		}
+		return r;
+	}
+
+	private:
+	profile_registry* m_registry = nullptr;
+	statement_profile* m_profile = nullptr;
+};
+
+} /* namespace sqlite  */
+
+#endif /* __PROFILE_HPP__ */
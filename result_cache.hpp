@@ -0,0 +1,459 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __RESULT_CACHE_HPP__
+#define __RESULT_CACHE_HPP__
+
+#include "change_feed.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sqlite {
+
+/*
+ * A query result decoded into two flat buffers, one fixed-size cell per
+ * value plus the bytes of all texts and blobs. Texts are NUL-terminated.
+ */
+struct cached_result {
+
+	explicit cached_result(statement& stmt) {
+		const auto h = stmt.handle.get();
+		m_columns = sqlite3_column_count(h);
+		for (int i = 0; i < m_columns; ++i) {
+			m_names.push_back(sqlite3_column_name(h, i));
+		}
+		while (stmt.step().has_data()) {
+			for (int i = 0; i < m_columns; ++i) {
+				cell c;
+				c.type = static_cast<datatype>(sqlite3_column_type(h, i));
+				c.size = 0;
+				switch (c.type) {
+					case INTEGER:
+						c.integer = sqlite3_column_int64(h, i);
+						break;
+					case FLOAT:
+						c.real = sqlite3_column_double(h, i);
+						break;
+					case TEXT:
+					case BLOB: {
+						const auto data = static_cast<const char*>(
+							c.type == TEXT ? static_cast<const void*>(sqlite3_column_text(h, i)) : sqlite3_column_blob(h, i));
+						c.size = static_cast<std::size_t>(sqlite3_column_bytes(h, i));
+						c.offset = m_bytes.size();
+						m_bytes.append(data != nullptr ? data : "", c.size);
+						m_bytes += '\0';
+						break;
+					}
+					default:
+						break;
+				}
+				m_cells.push_back(c);
+			}
+			++m_rows;
+		}
+	}
+
+	inline std::size_t rows() const noexcept { return m_rows; }
+	inline int columns() const noexcept { return m_columns; }
+	inline const std::string& name(int column) const { return m_names[column]; }
+
+	inline datatype get_type(std::size_t row, int column) const { return at(row, column).type; }
+	inline bool is_null(std::size_t row, int column) const { return at(row, column).type == NULL_TYPE; }
+
+	// converted like sqlite3_column_int64/double for the numeric types, 0 otherwise
+	int64_t get_int64(std::size_t row, int column) const {
+		const auto& c = at(row, column);
+		return c.type == INTEGER ? c.integer : c.type == FLOAT ? static_cast<int64_t>(c.real) : 0;
+	}
+
+	double get_double(std::size_t row, int column) const {
+		const auto& c = at(row, column);
+		return c.type == FLOAT ? c.real : c.type == INTEGER ? static_cast<double>(c.integer) : 0.0;
+	}
+
+	// empty for numbers and NULL
+	inline text_view get_text(std::size_t row, int column) const {
+		const auto& c = at(row, column);
+		return c.size == 0 ? text_view{"", 0} : text_view{m_bytes.data() + c.offset, c.size};
+	}
+
+	inline blob_view get_blob(std::size_t row, int column) const {
+		const auto t = get_text(row, column);
+		return blob_view{t.data, t.size};
+	}
+
+	// what the cache charges against its budget
+	inline std::size_t memory() const noexcept {
+		std::size_t names = 0;
+		for (const auto& n : m_names) {
+			names += n.capacity();
+		}
+		return sizeof(*this) + m_cells.capacity() * sizeof(cell) + m_bytes.capacity() + names;
+	}
+
+	private:
+	struct cell {
+		datatype type;
+		std::size_t size;
+		union {
+			int64_t integer;
+			double real;
+			std::size_t offset;
+		};
+	};
+
+	int m_columns = 0;
+	std::size_t m_rows = 0;
+	std::vector<std::string> m_names;
+	std::vector<cell> m_cells;
+	std::string m_bytes;
+
+	inline const cell& at(std::size_t row, int column) const { return m_cells[row * m_columns + column]; }
+};
+
+struct result_cache_stats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t bypassed = 0;    // queries run uncached: inside a transaction, or of tables no batch reports
+	uint64_t invalidated = 0; // entries found stale and dropped
+	uint64_t evictions = 0;   // dropped for the memory budget
+};
+
+namespace detail {
+
+	// parameter values appended to a cache key, tagged by type
+	template<typename T>
+	inline typename std::enable_if<std::is_integral<T>::value>::type append_key(std::string& key, const T value) {
+		const auto v = static_cast<int64_t>(value);
+		key += 'i';
+		key.append(reinterpret_cast<const char*>(&v), sizeof v);
+	}
+
+	inline void append_key(std::string& key, const double value) {
+		key += 'f';
+		key.append(reinterpret_cast<const char*>(&value), sizeof value);
+	}
+
+	inline void append_key(std::string& key, std::nullptr_t) { key += 'n'; }
+
+	inline void append_key_bytes(std::string& key, char tag, const char* data, std::size_t size) {
+		const auto n = static_cast<uint64_t>(size);
+		key += tag;
+		key.append(reinterpret_cast<const char*>(&n), sizeof n);
+		key.append(data, size);
+	}
+
+	inline void append_key(std::string& key, const std::string& value) { append_key_bytes(key, 's', value.data(), value.size()); }
+	inline void append_key(std::string& key, const char* value) { append_key_bytes(key, 's', value, std::strlen(value)); }
+	inline void append_key(std::string& key, const text_view& value) { append_key_bytes(key, 's', value.data, value.size); }
+
+	inline void append_key(std::string& key, const blob_view& value) {
+		append_key_bytes(key, 'b', static_cast<const char*>(value.data), value.size);
+	}
+
+} /* namespace detail */
+
+/*
+ * Memoizes read-only queries of one connection by SQL text plus parameter
+ * values, within a memory budget with LRU eviction. Each entry remembers
+ * the tables its query reads (found once per SQL text, through the
+ * authorizer and the b-trees its program opens) and is dropped once a
+ * change_feed batch of the same connection touches one of them:
+ *
+ *	change_feed feed(c);
+ *	result_cache cache(c, feed, 64 << 20);
+ *	auto r = cache.query("SELECT name FROM users WHERE id = ?", id);
+ *	r->get_text(0, 0);
+ *
+ * Results are shared, so one that is evicted stays valid for whoever
+ * holds it. Inside a transaction queries bypass the cache, since they could
+ * see uncommitted changes. The cache installs an authorizer on the
+ * connection, replacing any other, and uses it to turn off the
+ * truncate optimization of DELETE without WHERE, which would otherwise
+ * bypass the update hook. Writes by other connections or processes aren't
+ * seen, nor are schema changes (call clear()), and queries must be
+ * deterministic: no random() or 'now'. SQLite doesn't call the update
+ * hook for WITHOUT ROWID and virtual tables, so queries that read one are
+ * never cached; they run every time and count as bypassed.
+ */
+struct result_cache {
+
+	result_cache(connection& c, change_feed& feed, std::size_t budget = 16 << 20)
+	: m_conn(c), m_feed(feed), m_budget(budget) {
+		sqlite3_set_authorizer(m_conn.handle.get(), &result_cache::authorize, this);
+		// statements prepared before the authorizer may still truncate
+		m_conn.cache().clear();
+		m_subscription = m_feed.subscribe([this](const change_batch& batch) {
+			for (const auto t : batch.tables) {
+				invalidate(*t);
+			}
+		});
+	}
+
+	result_cache(const result_cache&) = delete;
+	result_cache& operator=(const result_cache&) = delete;
+
+	~result_cache() {
+		m_feed.unsubscribe(m_subscription);
+		sqlite3_set_authorizer(m_conn.handle.get(), nullptr, nullptr);
+	}
+
+	/*
+	 * The rows of sql with params bound to ?1, ?2, ..., from the cache or
+	 * freshly run. Throws sql_error(SQLITE_MISUSE) for SQL that writes.
+	 */
+	template<typename... Params>
+	std::shared_ptr<const cached_result> query(const std::string& sql, const Params&... params) {
+		if (sqlite3_get_autocommit(m_conn.handle.get()) == 0) {
+			++m_stats.bypassed;
+			auto stmt = m_conn.prepare_cached(sql);
+			bind_all(stmt, params...);
+			return std::make_shared<const cached_result>(stmt);
+		}
+		std::string key = sql;
+		key += '\0';
+		const int ignored[] = {0, (detail::append_key(key, params), 0)...};
+		(void)ignored;
+
+		const auto it = m_index.find(key);
+		if (it != m_index.end()) {
+			if (fresh(*it->second)) {
+				++m_stats.hits;
+				m_entries.splice(m_entries.begin(), m_entries, it->second);
+				return it->second->result;
+			}
+			++m_stats.invalidated;
+			erase(it->second);
+		}
+		const auto& reads = tables_of(sql);
+		auto stmt = m_conn.prepare_cached(sql);
+		if (sqlite3_stmt_readonly(stmt.handle.get()) == 0) {
+			throw sql_error(SQLITE_MISUSE, "result_cache: only read-only statements can be cached");
+		}
+		bind_all(stmt, params...);
+		if (!reads.cacheable) {
+			++m_stats.bypassed;
+			return std::make_shared<const cached_result>(stmt);
+		}
+		++m_stats.misses;
+		entry e;
+		e.result = std::make_shared<const cached_result>(stmt);
+		for (const auto t : reads.versions) {
+			e.tables.push_back(std::make_pair(t, *t));
+		}
+		e.memory = e.result->memory() + 2 * key.capacity() + e.tables.capacity() * sizeof(e.tables[0]);
+		auto result = e.result;
+		if (e.memory <= m_budget) {
+			e.key = std::move(key);
+			m_memory += e.memory;
+			m_entries.push_front(std::move(e));
+			m_index.emplace(m_entries.front().key, m_entries.begin());
+			trim();
+		}
+		return result;
+	}
+
+	// drops every entry that read table
+	void invalidate(const std::string& table) { ++m_generations[table]; }
+
+	void clear() noexcept {
+		m_index.clear();
+		m_entries.clear();
+		m_tables.clear();
+		m_memory = 0;
+	}
+
+	void set_budget(std::size_t budget) {
+		m_budget = budget;
+		trim();
+	}
+
+	inline std::size_t budget() const noexcept { return m_budget; }
+	inline std::size_t memory() const noexcept { return m_memory; }
+	inline std::size_t size() const noexcept { return m_entries.size(); }
+	inline const result_cache_stats& stats() const noexcept { return m_stats; }
+
+	private:
+	// a table's generation and its value when the entry was filled
+	using table_version = std::pair<const uint64_t*, uint64_t>;
+
+	struct entry {
+		std::string key;
+		std::shared_ptr<const cached_result> result;
+		std::vector<table_version> tables;
+		std::size_t memory = 0;
+	};
+
+	connection& m_conn;
+	change_feed& m_feed;
+	std::size_t m_subscription = 0;
+	std::size_t m_budget;
+	std::size_t m_memory = 0;
+	std::list<entry> m_entries; // most recently used first
+	std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+	// invalidate() bumps a generation instead of visiting entries; nodes never move
+	std::unordered_map<std::string, uint64_t> m_generations;
+	struct table_reads {
+		std::vector<const uint64_t*> versions;
+		bool cacheable = true; // false if a table read reports no changes
+	};
+
+	// (database, table)
+	using table_name = std::pair<std::string, std::string>;
+
+	std::unordered_map<std::string, table_reads> m_tables; // by SQL text
+	std::vector<table_name>* m_reads = nullptr; // set while tables_of() prepares
+	bool m_dropping = false;
+	result_cache_stats m_stats;
+
+	template<typename... Params>
+	static void bind_all(statement& stmt, const Params&... params) {
+		int index = 0;
+		const int ignored[] = {0, (stmt.bind(++index, params), 0)...};
+		(void)ignored;
+	}
+
+	static bool fresh(const entry& e) noexcept {
+		for (const auto& t : e.tables) {
+			if (*t.first != t.second) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void erase(std::list<entry>::iterator it) {
+		m_memory -= it->memory;
+		m_index.erase(it->key);
+		m_entries.erase(it);
+	}
+
+	void trim() {
+		while (m_memory > m_budget && !m_entries.empty()) {
+			erase(std::prev(m_entries.end()));
+			++m_stats.evictions;
+		}
+	}
+
+	/*
+	 * The authorizer only names tables whose columns are read, so count(*)
+	 * would slip through; the b-trees opened by the EXPLAIN program (and
+	 * looked up by root page) catch those. A VOpen in the program, or a
+	 * table declared WITHOUT ROWID, makes the query uncacheable.
+	 */
+	const table_reads& tables_of(const std::string& sql) {
+		const auto it = m_tables.find(sql);
+		if (it != m_tables.end()) {
+			return it->second;
+		}
+		table_reads result;
+		std::vector<table_name> names;
+		m_reads = &names;
+		statement program;
+		const auto r = program.prepare(m_conn, "EXPLAIN " + sql);
+		m_reads = nullptr;
+		r.check();
+		std::vector<std::pair<int, int64_t>> roots; // database index, root page
+		while (program.step().has_data()) {
+			const auto opcode = program.get_text(1).str();
+			const bool p2_is_register = (program.get_int64(6) & 0x02) != 0; // p5, OPFLAG_P2ISREG
+			if (opcode == "OpenRead" && !p2_is_register) {
+				roots.push_back(std::make_pair(static_cast<int>(program.get_int64(4)), program.get_int64(3)));
+			} else if (opcode == "VOpen") {
+				result.cacheable = false;
+			}
+		}
+		std::unordered_map<int, std::string> databases;
+		if (!roots.empty()) {
+			auto list = statement::create(m_conn, "PRAGMA database_list");
+			while (list.step().has_data()) {
+				databases[static_cast<int>(list.get_int64(0))] = list.get_string(1);
+			}
+		}
+		for (const auto& root : roots) {
+			const auto& database = databases[root.first];
+			auto owner = statement::create(m_conn, "SELECT tbl_name FROM " + master_of(database) + " WHERE rootpage = ?");
+			owner.bind(1, root.second);
+			if (owner.step().has_data()) {
+				names.push_back(table_name(database, owner.get_string(0)));
+			}
+		}
+		// the authorizer names a table once per column read
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+		for (const auto& name : names) {
+			remember_read(result.versions, name.second.c_str());
+			if (result.cacheable && !reports_changes(name)) {
+				result.cacheable = false;
+			}
+		}
+		return m_tables.emplace(sql, std::move(result)).first->second;
+	}
+
+	static std::string master_of(const std::string& database) {
+		return database == "temp" ? std::string("sqlite_temp_master") : detail::quote_identifier(database) + ".sqlite_master";
+	}
+
+	// false for WITHOUT ROWID and virtual tables, which never reach the update hook
+	bool reports_changes(const table_name& name) {
+		if (std::strncmp(name.second.c_str(), "sqlite_", 7) == 0) {
+			return true;
+		}
+		// LIKE ignores case; a false match only costs the caching
+		auto table = statement::create(m_conn, "SELECT 1 FROM " + master_of(name.first) + " WHERE type = 'table' AND name = ?"
+							       " AND (sql LIKE 'CREATE VIRTUAL%' OR sql LIKE '%WITHOUT%ROWID%')");
+		table.bind(1, name.second);
+		return !table.step().has_data();
+	}
+
+	void remember_read(std::vector<const uint64_t*>& reads, const char* table) {
+		const auto version = &m_generations[table];
+		if (std::find(reads.begin(), reads.end(), version) == reads.end()) {
+			reads.push_back(version);
+		}
+	}
+
+	static int authorize(void* self, int action, const char* table, const char*, const char* database, const char*) {
+		auto& cache = *static_cast<result_cache*>(self);
+		switch (action) {
+			case SQLITE_DROP_TABLE:
+			case SQLITE_DROP_TEMP_TABLE:
+			case SQLITE_DROP_VIEW:
+			case SQLITE_DROP_TEMP_VIEW:
+				// DROP checks SQLITE_DELETE on the table next, and gives up on SQLITE_IGNORE
+				cache.m_dropping = true;
+				return SQLITE_OK;
+			case SQLITE_DELETE:
+				if (cache.m_dropping || table == nullptr || std::strncmp(table, "sqlite_", 7) == 0) {
+					cache.m_dropping = false;
+					return SQLITE_OK;
+				}
+				// the DELETE still happens, row by row, through the update hook
+				return SQLITE_IGNORE;
+			default:
+				break;
+		}
+		if (action == SQLITE_READ && cache.m_reads != nullptr && table != nullptr) {
+			try {
+				cache.m_reads->push_back(table_name(database != nullptr ? database : "main", table));
+			} catch (...) {
+				return SQLITE_DENY;
+			}
+		}
+		return SQLITE_OK;
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __RESULT_CACHE_HPP__ */
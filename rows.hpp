@@ -0,0 +1,188 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __ROWS_HPP__
+#define __ROWS_HPP__
+
+#include "typed_statement.hpp"
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace sqlite {
+
+namespace detail {
+
+	template<bool... B>
+	struct any_of : std::false_type {};
+
+	template<bool... B>
+	struct any_of<true, B...> : std::true_type {};
+
+	template<bool... B>
+	struct any_of<false, B...> : any_of<B...> {};
+
+	// std::vector<bool> packs bits and has no data(), so bools are kept as bytes
+	template<typename T>
+	struct column_storage {
+		using type = T;
+	};
+
+	template<>
+	struct column_storage<bool> {
+		using type = uint8_t;
+	};
+
+} /* namespace detail */
+
+/*
+ * Input iterator over the rows of a statement. Dereferencing yields the
+ * statement itself, positioned on the current row, so the usual getters
+ * apply: for (auto& row : rows(select)) { row.get_int(0); }
+ */
+struct row_iterator {
+
+	using iterator_category = std::input_iterator_tag;
+	using value_type = statement;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const statement*;
+	using reference = const statement&;
+
+	row_iterator() noexcept : m_stmt(nullptr) {}
+	explicit row_iterator(const statement& stmt) : m_stmt(&stmt) { advance(); }
+
+	inline reference operator*() const noexcept { return *m_stmt; }
+	inline pointer operator->() const noexcept { return m_stmt; }
+
+	inline row_iterator& operator++() {
+		advance();
+		return *this;
+	}
+
+	inline bool operator==(const row_iterator& rhs) const noexcept { return m_stmt == rhs.m_stmt; }
+	inline bool operator!=(const row_iterator& rhs) const noexcept { return m_stmt != rhs.m_stmt; }
+
+	private:
+	const statement* m_stmt; // nullptr past the last row
+
+	void advance() {
+		if (!m_stmt->step().has_data()) {
+			m_stmt = nullptr;
+		}
+	}
+};
+
+struct row_range {
+	const statement& stmt;
+
+	// begin() steps to the first row, so a range is walked only once
+	inline row_iterator begin() const { return row_iterator(stmt); }
+	inline row_iterator end() const noexcept { return row_iterator(); }
+};
+
+inline row_range rows(const statement& stmt) { return row_range{stmt}; }
+
+/*
+ * A block of rows stored column by column: column<I>() is a contiguous
+ * std::vector of the I-th column's values, ready for vectorized loops.
+ * bool columns are a std::vector<uint8_t> of 0 and 1. Views would dangle
+ * after the next step(), so only owning types are allowed here.
+ */
+template<typename... Cols>
+struct row_batch {
+
+	static_assert(sizeof...(Cols) > 0, "row_batch needs at least one column");
+	static_assert(!detail::any_of<std::is_same<Cols, text_view>::value...>::value
+		      && !detail::any_of<std::is_same<Cols, blob_view>::value...>::value,
+		      "row_batch cannot hold views, use std::string instead");
+
+	using storage = std::tuple<std::vector<typename detail::column_storage<Cols>::type>...>;
+
+	storage columns;
+
+	template<std::size_t I>
+	inline typename std::tuple_element<I, storage>::type& column() noexcept {
+		return std::get<I>(columns);
+	}
+
+	template<std::size_t I>
+	inline const typename std::tuple_element<I, storage>::type& column() const noexcept {
+		return std::get<I>(columns);
+	}
+
+	inline std::size_t size() const noexcept { return std::get<0>(columns).size(); }
+	inline bool empty() const noexcept { return size() == 0; }
+
+	void clear() noexcept { clear(typename detail::make_indices<sizeof...(Cols)>::type()); }
+
+	void reserve(std::size_t n) { reserve(n, typename detail::make_indices<sizeof...(Cols)>::type()); }
+
+	private:
+	template<std::size_t... I>
+	inline void clear(detail::indices<I...>) noexcept {
+		const int expand[] = {0, (std::get<I>(columns).clear(), 0)...};
+		(void)expand;
+	}
+
+	template<std::size_t... I>
+	inline void reserve(std::size_t n, detail::indices<I...>) {
+		const int expand[] = {0, (std::get<I>(columns).reserve(n), 0)...};
+		(void)expand;
+		(void)n;
+	}
+};
+
+/*
+ * Pulls rows from a statement n at a time into a reused row_batch:
+ *
+ *	batch_reader<int64_t, double> reader(select);
+ *	while (reader.next(4096)) { sum(reader.batch().column<1>()); }
+ *
+ * The reader remembers SQLITE_DONE so the statement is not restarted.
+ */
+template<typename... Cols>
+struct batch_reader {
+
+	explicit batch_reader(const statement& stmt) : m_stmt(stmt) {
+		if (sqlite3_column_count(stmt.handle.get()) != static_cast<int>(sizeof...(Cols))) {
+			throw sql_error(SQLITE_MISUSE, "batch_reader: column count does not match the statement");
+		}
+	}
+
+	// refills the batch with up to n rows; false once nothing is left
+	bool next(std::size_t n) {
+		m_batch.clear();
+		m_batch.reserve(n);
+		while (!m_done && m_batch.size() < n) {
+			if (!m_stmt.step().has_data()) {
+				m_done = true;
+				break;
+			}
+			append(typename detail::make_indices<sizeof...(Cols)>::type());
+		}
+		return !m_batch.empty();
+	}
+
+	inline const row_batch<Cols...>& batch() const noexcept { return m_batch; }
+	inline row_batch<Cols...>& batch() noexcept { return m_batch; }
+	inline bool done() const noexcept { return m_done; }
+
+	private:
+	const statement& m_stmt;
+	row_batch<Cols...> m_batch;
+	bool m_done = false;
+
+	template<std::size_t... I>
+	inline void append(detail::indices<I...>) {
+		const auto h = m_stmt.handle.get();
+		const int expand[] = {0, (std::get<I>(m_batch.columns).push_back(value_traits<Cols>::get(h, static_cast<int>(I))), 0)...};
+		(void)expand;
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __ROWS_HPP__ */
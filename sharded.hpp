@@ -0,0 +1,264 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __SHARDED_HPP__
+#define __SHARDED_HPP__
+
+#include "async.hpp"
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sqlite {
+
+namespace detail {
+
+	// splitmix64's finalizer, so identity hashes of sequential keys spread over the shards
+	inline uint64_t mix_hash(uint64_t h) noexcept {
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		return h ^ (h >> 31);
+	}
+
+	// what gather() returns: a vector of results, or nothing for void
+	template<typename R>
+	struct gathered {
+		using type = std::vector<R>;
+	};
+
+	template<>
+	struct gathered<void> {
+		using type = void;
+	};
+
+} /* namespace detail */
+
+/*
+ * N database files, each behind its own async_connection, with rows
+ * routed by a hash of their key. Every shard has its own writer thread
+ * and write batching, so writes to different shards run in parallel.
+ * Nothing spans shards: there are no cross-shard transactions, and a
+ * write for one key only ever sees its own shard.
+ *
+ *	sharded_database<int64_t> db({"users.0.db", "users.1.db", "users.2.db", "users.3.db"});
+ *	db.write(user_id, [=](connection& c) { ... });
+ *	auto counts = db.gather([](connection& c) { ... return n; });
+ *
+ * Hash is applied to the key first and its result mixed, so std::hash's
+ * identity for integers is fine. Changing the number of shards, or the
+ * hash, moves keys; existing files don't get rebalanced.
+ * Requires the sqlitepp11_mt library.
+ */
+template<typename Key, typename Hash = std::hash<Key>>
+struct sharded_database {
+
+	explicit sharded_database(std::vector<std::string> files, const connection_options& options = connection_options::read_heavy(),
+				  std::size_t max_batch = 256, Hash hash = Hash())
+	: m_files(std::move(files)), m_hash(std::move(hash)) {
+		if (m_files.empty()) {
+			throw sql_error(SQLITE_MISUSE, "sharded_database needs at least one shard");
+		}
+		m_shards.reserve(m_files.size());
+		for (const auto& file : m_files) {
+			m_shards.emplace_back(new async_connection([file, options] { return connection::create(file.c_str(), options); },
+								   max_batch));
+		}
+	}
+
+	sharded_database(const sharded_database&) = delete;
+	sharded_database& operator=(const sharded_database&) = delete;
+
+	inline std::size_t size() const noexcept { return m_shards.size(); }
+	inline const std::string& file(std::size_t shard) const { return m_files[shard]; }
+	inline async_connection& shard(std::size_t index) { return *m_shards[index]; }
+
+	inline std::size_t shard_of(const Key& key) const {
+		return static_cast<std::size_t>(detail::mix_hash(static_cast<uint64_t>(m_hash(key))) % m_shards.size());
+	}
+
+	// f(connection&) on the writer thread of key's shard, batched with that shard's other writes
+	template<typename F>
+	auto write(const Key& key, F f) -> std::future<typename detail::async_result<F>::type> {
+		return m_shards[shard_of(key)]->write(std::move(f));
+	}
+
+	template<typename F>
+	auto read(const Key& key, F f) -> std::future<typename detail::async_result<F>::type> {
+		return m_shards[shard_of(key)]->read(std::move(f));
+	}
+
+	// f(connection&) queued as a read on every shard at once; the futures are in shard order
+	template<typename F>
+	auto scatter(F f) -> std::vector<std::future<typename detail::async_result<F>::type>> {
+		std::vector<std::future<typename detail::async_result<F>::type>> result;
+		result.reserve(m_shards.size());
+		for (auto& s : m_shards) {
+			result.push_back(s->read(f));
+		}
+		return result;
+	}
+
+	// scatter() and wait for every shard; the first error is rethrown once all are done
+	template<typename F>
+	auto gather(F f) -> typename detail::gathered<typename detail::async_result<F>::type>::type {
+		return collect(scatter(std::move(f)));
+	}
+
+	/*
+	 * Runs sql (from each shard's statement cache) on every shard and
+	 * concatenates the rows in shard order; read(statement&) turns the
+	 * current row into a T.
+	 */
+	template<typename T, typename Read>
+	std::vector<T> gather_rows(const std::string& sql, Read read) {
+		std::vector<T> result;
+		for (auto& rows : gather(row_reader<T, Read>(sql, read))) {
+			std::move(rows.begin(), rows.end(), std::back_inserter(result));
+		}
+		return result;
+	}
+
+	/*
+	 * gather_rows() for queries that ORDER BY the same thing on every
+	 * shard: the sorted per-shard results are merged with less, as a
+	 * single ORDER BY over all shards would return them.
+	 */
+	template<typename T, typename Read, typename Less>
+	std::vector<T> gather_rows(const std::string& sql, Read read, Less less) {
+		auto parts = gather(row_reader<T, Read>(sql, read));
+		// pairwise merges, the sizes stay balanced
+		while (parts.size() > 1) {
+			std::vector<std::vector<T>> next;
+			for (std::size_t i = 0; i + 1 < parts.size(); i += 2) {
+				std::vector<T> merged;
+				merged.reserve(parts[i].size() + parts[i + 1].size());
+				std::merge(std::make_move_iterator(parts[i].begin()), std::make_move_iterator(parts[i].end()),
+					   std::make_move_iterator(parts[i + 1].begin()), std::make_move_iterator(parts[i + 1].end()),
+					   std::back_inserter(merged), less);
+				next.push_back(std::move(merged));
+			}
+			if (parts.size() % 2 != 0) {
+				next.push_back(std::move(parts.back()));
+			}
+			parts = std::move(next);
+		}
+		return parts.empty() ? std::vector<T>() : std::move(parts.front());
+	}
+
+	/*
+	 * ATTACHes every shard to c as prefix0, prefix1, ... for ad-hoc
+	 * queries across all of them, e.g. over union_all("users"). c sees
+	 * each file as of its own read transaction. SQLite attaches at most
+	 * SQLITE_LIMIT_ATTACHED (10 by default) databases, counting those c
+	 * already has; with more shards than that this throws
+	 * sql_error(SQLITE_RANGE) before attaching any. If an ATTACH fails,
+	 * the shards attached so far are detached again.
+	 */
+	void attach_all(connection& c, const std::string& prefix = "shard") const {
+		const auto db = c.handle.get();
+		std::size_t attached = 0;
+		auto list = statement::create(c, "PRAGMA database_list");
+		while (list.step().has_data()) {
+			attached += list.get_int64(0) >= 2 ? 1 : 0; // 0 is main, 1 is temp
+		}
+		const auto limit = static_cast<std::size_t>(sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1));
+		if (attached + m_files.size() > limit) {
+			throw sql_error(SQLITE_RANGE, "attach_all: " + std::to_string(m_files.size()) + " shards and "
+						      + std::to_string(attached) + " attached databases exceed the limit of "
+						      + std::to_string(limit));
+		}
+		std::size_t i = 0;
+		try {
+			for (; i < m_files.size(); ++i) {
+				auto attach = statement::create(c, "ATTACH DATABASE ? AS " + detail::quote_identifier(prefix + std::to_string(i)));
+				attach.bind(1, m_files[i]);
+				attach.step();
+			}
+		} catch (...) {
+			while (i-- > 0) {
+				const auto detach = "DETACH DATABASE " + detail::quote_identifier(prefix + std::to_string(i));
+				sqlite3_exec(db, detach.c_str(), nullptr, nullptr, nullptr);
+			}
+			throw;
+		}
+	}
+
+	// SELECT * FROM prefix0.table UNION ALL SELECT * FROM prefix1.table ..., for use after attach_all()
+	std::string union_all(const std::string& table, const std::string& prefix = "shard") const {
+		std::string result;
+		for (std::size_t i = 0; i < m_files.size(); ++i) {
+			result += i == 0 ? "SELECT * FROM " : " UNION ALL SELECT * FROM ";
+			result += detail::quote_identifier(prefix + std::to_string(i)) + "." + detail::quote_identifier(table);
+		}
+		return result;
+	}
+
+	private:
+	std::vector<std::string> m_files;
+	Hash m_hash;
+	std::vector<std::unique_ptr<async_connection>> m_shards;
+
+	template<typename T, typename Read>
+	struct row_reader {
+		std::string sql;
+		Read read;
+
+		row_reader(std::string s, Read r) : sql(std::move(s)), read(std::move(r)) {}
+
+		std::vector<T> operator()(connection& c) {
+			std::vector<T> rows;
+			auto stmt = c.prepare_cached(sql);
+			while (stmt.step().has_data()) {
+				rows.push_back(read(stmt));
+			}
+			return rows;
+		}
+	};
+
+	template<typename R>
+	static std::vector<R> collect(std::vector<std::future<R>> futures) {
+		std::vector<R> result;
+		result.reserve(futures.size());
+		std::exception_ptr error;
+		for (auto& f : futures) {
+			try {
+				result.push_back(f.get());
+			} catch (...) {
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return result;
+	}
+
+	static void collect(std::vector<std::future<void>> futures) {
+		std::exception_ptr error;
+		for (auto& f : futures) {
+			try {
+				f.get();
+			} catch (...) {
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __SHARDED_HPP__ */
@@ -7,7 +7,27 @@
 #define __SQLITE_HPP__
 
 #include "sqlite3/sqlite3.h"
-#include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#endif
 #include "handle.hpp"
 
 namespace sqlite {
@@ -21,6 +41,73 @@ enum datatype {
 	NULL_TYPE = 5
 };
 
+/*
+ * Non-owning views into a column of the current row. They stay valid until
+ * the next step(), reset or finalize of the statement they came from.
+ */
+struct text_view {
+	const char* data;
+	std::size_t size;
+
+	inline bool empty() const noexcept { return size == 0; }
+	inline const char* begin() const noexcept { return data; }
+	inline const char* end() const noexcept { return data + size; }
+	inline std::string str() const { return std::string(data, size); }
+};
+
+struct blob_view {
+	const void* data;
+	std::size_t size;
+
+	inline bool empty() const noexcept { return size == 0; }
+	inline const unsigned char* begin() const noexcept { return static_cast<const unsigned char*>(data); }
+	inline const unsigned char* end() const noexcept { return begin() + size; }
+};
+
+namespace detail {
+
+	// "name" with embedded quotes doubled, for identifiers spliced into SQL
+	inline std::string quote_identifier(const std::string& name) {
+		std::string result = "\"";
+		for (const char c : name) {
+			result += c;
+			if (c == '"') {
+				result += '"';
+			}
+		}
+		return result + '"';
+	}
+
+	// binds element I.. of a tuple to consecutive parameters starting at first
+	template<std::size_t I, std::size_t N>
+	struct tuple_binder {
+		template<typename Statement, typename Tuple>
+		static void bind(Statement& stmt, const Tuple& values, const int first) {
+			stmt.create_binding(first + static_cast<int>(I), std::get<I>(values)).check();
+			tuple_binder<I + 1, N>::bind(stmt, values, first);
+		}
+	};
+
+	template<std::size_t N>
+	struct tuple_binder<N, N> {
+		template<typename Statement, typename Tuple>
+		static void bind(Statement&, const Tuple&, const int) {}
+	};
+
+	// C++11 stand-in for std::index_sequence
+	template<std::size_t... I>
+	struct indices {};
+
+	template<std::size_t N, std::size_t... I>
+	struct make_indices : make_indices<N - 1, N - 1, I...> {};
+
+	template<std::size_t... I>
+	struct make_indices<0, I...> {
+		using type = indices<I...>;
+	};
+
+} /* namespace detail */
+
 struct connection_handle_traits {
 	using pointer = sqlite3 *;
 
@@ -52,106 +139,689 @@ struct sql_error : std::exception {
 
 };
 
+/*
+ * The return code of a sqlite call plus the database it came from. Nothing
+ * is allocated until the error message is asked for, so results are cheap
+ * to pass around on the hot path; check() turns a failure into a sql_error.
+ */
 struct sql_result {
 	int value;
 
-	static inline sql_result from_cmd(int value,const connection_handle& handle) {
-		if (value == SQLITE_OK) {
-			return sql_result(value);
-		} else {
-			return sql_result(value, sql_error(value, sqlite3_errmsg(handle.get())));
-		} 
+	static inline sql_result from_cmd(int value, const connection_handle& handle) noexcept {
+		return sql_result(value, handle.get());
 	}
-	static inline sql_result from_cmd(int value,const statement_handle& handle) {
-		if (value == SQLITE_OK) {
-			return sql_result(value);
-		} else {
-			return sql_result(value, sql_error(value, sqlite3_errmsg(sqlite3_db_handle(handle.get()))));
-		} 
+	static inline sql_result from_cmd(int value, sqlite3* db) noexcept {
+		return sql_result(value, db);
+	}
+	static inline sql_result from_cmd(int value, const statement_handle& handle) noexcept {
+		return sql_result(value, sqlite3_db_handle(handle.get()));
 	}
 
-	static inline sql_result from_stmt(int value,const statement_handle& handle) {
-		if (value == SQLITE_ROW || value == SQLITE_DONE) {
-			return sql_result(value);
-		} else {
-			return sql_result(value, sql_error(value, sqlite3_errmsg(sqlite3_db_handle(handle.get()))));
-		} 
+	static inline sql_result from_stmt(int value, const statement_handle& handle) noexcept {
+		return sql_result(value, sqlite3_db_handle(handle.get()));
 	}
 
-	sql_result(sql_result& rhs) :value(rhs.value),m_saw_error(rhs.m_saw_error),m_err(rhs.m_err) {
-		if(!m_saw_error) {
-			rhs.m_saw_error = true;
-		}
+	inline bool has_data() const noexcept { return value == SQLITE_ROW; }
+	inline bool ok() const noexcept { return value == SQLITE_OK; }
+	inline bool done() const noexcept { return value == SQLITE_DONE; }
+	inline bool failed() const noexcept { return value != SQLITE_OK && value != SQLITE_ROW && value != SQLITE_DONE; }
+
+	// the message is read from the connection, so ask before the next call on it
+	sql_error error() const {
+		return sql_error(value, m_db != nullptr ? sqlite3_errmsg(m_db) : sqlite3_errstr(value));
 	}
 
-	sql_result(sql_result&& rhs): value(std::move(rhs.value)),m_saw_error(std::move(rhs.m_saw_error)),m_err(std::move(rhs.m_err)) {}
+	void throw_error() const { throw error(); }
 
-	sql_result& operator=(sql_result& rhs) {
-		value = rhs.value;
-		m_err = rhs.m_err;
-		m_saw_error = rhs.m_saw_error;
-		if(!m_saw_error) {
-			rhs.m_saw_error = true;
+	inline const sql_result& check() const {
+		if (failed()) {
+			throw_error();
 		}
 		return *this;
 	}
 
-	sql_result& operator=(sql_result&& rhs) {
-		value = std::move(rhs.value);
-		m_err = std::move(rhs.m_err);
-		m_saw_error = std::move(rhs.m_saw_error);
-		return *this;
+	explicit operator bool() const noexcept {
+		return !failed();
+	}
+
+	private:
+	sqlite3* m_db;
+
+	sql_result(int _value, sqlite3* db) noexcept : value(_value), m_db(db) {}
+
+};
 
+/*
+ * Bounded LRU of prepared statements keyed by their SQL text. Handles are
+ * checked out with acquire() and put back with release(); a statement that
+ * is checked out twice at the same time is simply prepared twice and the
+ * surplus copy is finalized when it comes back.
+ */
+struct statement_cache {
+
+	explicit statement_cache(std::size_t capacity = 32) : m_capacity(capacity) {}
+
+	statement_cache(const statement_cache&) = delete;
+	statement_cache& operator=(const statement_cache&) = delete;
+
+	// returns an empty handle on a miss
+	statement_handle acquire(const std::string& sql) {
+		const auto it = m_index.find(sql);
+		if (it == m_index.end()) {
+			++m_misses;
+			return statement_handle{};
+		}
+		++m_hits;
+		auto result = std::move(it->second->second);
+		m_entries.erase(it->second);
+		m_index.erase(it);
+		sqlite3_reset(result.get());
+		sqlite3_clear_bindings(result.get());
+		return result;
 	}
-	 ~sql_result() {
-	 	if(!m_saw_error) {
-			throw *m_err;
+
+	void release(const std::string& sql, statement_handle stmt) {
+		if (!stmt || m_capacity == 0 || m_index.count(sql) != 0) {
+			return; // finalized by the handle
 		}
-	 }
+		// reset right away so an idle statement does not hold a read lock
+		sqlite3_reset(stmt.get());
+		m_entries.emplace_front(sql, std::move(stmt));
+		m_index.emplace(sql, m_entries.begin());
+		trim();
+	}
 
+	void clear() noexcept {
+		m_index.clear();
+		m_entries.clear();
+	}
 
-	inline bool has_data() const noexcept { return value == SQLITE_ROW; }
-	inline bool ok() const noexcept { return value == SQLITE_OK; }
-	inline bool done() const noexcept { return value == SQLITE_DONE; }
+	void set_capacity(std::size_t capacity) {
+		m_capacity = capacity;
+		trim();
+	}
+
+	inline std::size_t capacity() const noexcept { return m_capacity; }
+	inline std::size_t size() const noexcept { return m_entries.size(); }
+	inline std::size_t hits() const noexcept { return m_hits; }
+	inline std::size_t misses() const noexcept { return m_misses; }
+	inline std::size_t evictions() const noexcept { return m_evictions; }
 
-	void throw_error() { m_saw_error = true; throw *m_err; }
+	inline void reset_counters() noexcept { m_hits = m_misses = m_evictions = 0; }
 
-	inline const boost::optional<sql_error>& error() noexcept { 
-		m_saw_error = true; 
-		return m_err; 
+	private:
+	using entry = std::pair<std::string, statement_handle>;
+
+	std::size_t m_capacity;
+	std::size_t m_hits = 0;
+	std::size_t m_misses = 0;
+	std::size_t m_evictions = 0;
+	std::list<entry> m_entries; // most recently returned first
+	std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+
+	void trim() {
+		while (m_entries.size() > m_capacity) {
+			m_index.erase(m_entries.back().first);
+			m_entries.pop_back();
+			++m_evictions;
+		}
 	}
-	
-	explicit operator bool() const {
-		return has_data() && ok() && done(); // should be okay in the context
+};
+
+enum journal_mode {
+	JOURNAL_DEFAULT = 0, // leave whatever the database file has
+	JOURNAL_DELETE,
+	JOURNAL_TRUNCATE,
+	JOURNAL_PERSIST,
+	JOURNAL_MEMORY,
+	JOURNAL_WAL,
+	JOURNAL_OFF
+};
+
+enum synchronous_mode {
+	SYNC_DEFAULT = 0,
+	SYNC_OFF,
+	SYNC_NORMAL,
+	SYNC_FULL
+};
+
+enum temp_store_mode {
+	TEMP_DEFAULT = 0,
+	TEMP_FILE,
+	TEMP_MEMORY
+};
+
+/*
+ * Everything connection::create() sets up at open time. The defaults match
+ * a plain sqlite3_open(); the presets bundle the PRAGMAs services keep
+ * repeating. Numeric settings at their default are not sent at all.
+ */
+struct connection_options {
+	int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE; // e.g. | SQLITE_OPEN_NOMUTEX
+	const char* vfs = nullptr;
+	journal_mode journal = JOURNAL_DEFAULT; // ignored for SQLITE_OPEN_READONLY
+	synchronous_mode synchronous = SYNC_DEFAULT;
+	temp_store_mode temp_store = TEMP_DEFAULT;
+	int64_t mmap_size = -1;  // bytes, -1 keeps the compile-time default
+	int cache_size = 0;      // PRAGMA cache_size: pages, or KiB when negative
+	int busy_timeout = 0;    // milliseconds
+	int lookaside_size = 0;  // bytes per lookaside slot, 0 keeps the default
+	int lookaside_count = 0; // lookaside slots
+
+	// WAL readers do not block the writer; large mmap and page cache
+	static inline connection_options read_heavy() {
+		connection_options result;
+		result.journal = JOURNAL_WAL;
+		result.synchronous = SYNC_NORMAL;
+		result.temp_store = TEMP_MEMORY;
+		result.mmap_size = 256ll << 20;
+		result.cache_size = -64 * 1024;
+		result.busy_timeout = 5000;
+		return result;
+	}
+
+	/*
+	 * No fsync at all, for loads that can be redone: an OS crash or power
+	 * loss may corrupt the file (a checkpoint can reset the WAL before the
+	 * pages it copied reach the disk), so rebuild it from the source then.
+	 * An application crash is safe.
+	 */
+	static inline connection_options bulk_load() {
+		connection_options result;
+		result.journal = JOURNAL_WAL;
+		result.synchronous = SYNC_OFF;
+		result.temp_store = TEMP_MEMORY;
+		result.cache_size = -256 * 1024;
+		result.busy_timeout = 5000;
+		return result;
+	}
+
+	// every commit is synced before it returns
+	static inline connection_options durable() {
+		connection_options result;
+		result.journal = JOURNAL_WAL;
+		result.synchronous = SYNC_FULL;
+		result.busy_timeout = 5000;
+		return result;
+	}
+
+	// "read-heavy", "bulk-load", "durable" or "default"
+	static inline connection_options preset(const std::string& name) {
+		if (name == "read-heavy") {
+			return read_heavy();
+		} else if (name == "bulk-load") {
+			return bulk_load();
+		} else if (name == "durable") {
+			return durable();
+		} else if (name == "default") {
+			return connection_options();
+		}
+		throw sql_error(SQLITE_MISUSE, "unknown connection preset: " + name);
+	}
+};
+
+/*
+ * Process-wide allocator figures from sqlite3_status(), in bytes unless
+ * noted. They stay at zero when SQLite is built with SQLITE_DEFAULT_MEMSTATUS=0.
+ */
+struct memory_stats {
+	int memory_used = 0;
+	int memory_highwater = 0;
+	int malloc_count = 0;           // outstanding allocations
+	int malloc_count_highwater = 0;
+	int largest_malloc = 0;         // biggest single request seen
+	int pagecache_used = 0;         // pages taken from SQLITE_CONFIG_PAGECACHE
+	int pagecache_highwater = 0;
+	int pagecache_overflow = 0;     // page bytes that had to come from malloc
+	int pagecache_overflow_highwater = 0;
+};
+
+namespace detail {
+
+	inline void read_status(int op, int& current, int& highwater, bool reset) {
+		sqlite3_status(op, &current, &highwater, reset ? 1 : 0);
+	}
+
+	inline void read_db_status(sqlite3* db, int op, int* current, int* highwater, bool reset) {
+		int cur = 0;
+		int hi = 0;
+		sqlite3_db_status(db, op, &cur, &hi, reset ? 1 : 0);
+		if (current != nullptr) {
+			*current = cur;
+		}
+		if (highwater != nullptr) {
+			*highwater = hi;
+		}
+	}
+
+} /* namespace detail */
+
+// reset restarts the high-water marks, for every connection in the process
+inline memory_stats memory_status(bool reset = false) {
+	memory_stats result;
+	int ignored = 0;
+	detail::read_status(SQLITE_STATUS_MEMORY_USED, result.memory_used, result.memory_highwater, reset);
+	detail::read_status(SQLITE_STATUS_MALLOC_COUNT, result.malloc_count, result.malloc_count_highwater, reset);
+	detail::read_status(SQLITE_STATUS_MALLOC_SIZE, ignored, result.largest_malloc, reset);
+	detail::read_status(SQLITE_STATUS_PAGECACHE_USED, result.pagecache_used, result.pagecache_highwater, reset);
+	detail::read_status(SQLITE_STATUS_PAGECACHE_OVERFLOW, result.pagecache_overflow,
+			    result.pagecache_overflow_highwater, reset);
+	return result;
+}
+
+/*
+ * One connection's sqlite3_db_status() figures. Memory is in bytes; the
+ * hit/miss/write and lookaside hit/miss numbers are counters since open
+ * or the last connection::stats(true).
+ */
+struct connection_stats {
+	int cache_used = 0;          // page cache of all attached databases
+	int cache_hit = 0;
+	int cache_miss = 0;
+	int cache_write = 0;         // dirty pages written out
+	int lookaside_used = 0;      // slots checked out right now
+	int lookaside_highwater = 0;
+	int lookaside_hit = 0;
+	int lookaside_miss_size = 0; // requests too large for a slot
+	int lookaside_miss_full = 0; // requests while every slot was taken
+	int schema_used = 0;
+	int stmt_used = 0;           // prepared statements, including cached ones
+	memory_stats memory;         // process wide, never reset by stats()
+
+	inline double cache_hit_ratio() const noexcept {
+		const auto total = cache_hit + cache_miss;
+		return total == 0 ? 0.0 : static_cast<double>(cache_hit) / total;
 	}
+};
+
+/*
+ * Statements a service declares up front, by name, so that
+ * connection::warmup() can prepare all of them at startup rather than on
+ * the first requests, and a statement that no longer compiles against the
+ * schema fails the deploy instead of a request. hot() lists tables whose
+ * pages warmup() reads into the page cache.
+ *
+ *	statement_registry queries;
+ *	queries.add("user_by_id", "SELECT * FROM users WHERE id = ?").hot("users");
+ *	c.warmup(queries);
+ *	auto stmt = c.prepare_cached(queries.sql("user_by_id"));
+ */
+struct statement_registry {
+
+	struct entry {
+		std::string name;
+		std::string sql;
+	};
+
+	// throws sql_error(SQLITE_MISUSE) if name is taken
+	statement_registry& add(std::string name, std::string sql) {
+		if (m_index.count(name) != 0) {
+			throw sql_error(SQLITE_MISUSE, "statement \"" + name + "\" is already registered");
+		}
+		m_index.emplace(name, m_entries.size());
+		m_entries.push_back(entry{std::move(name), std::move(sql)});
+		return *this;
+	}
+
+	statement_registry& hot(std::string table) {
+		m_hot.push_back(std::move(table));
+		return *this;
+	}
+
+	// throws sql_error(SQLITE_NOTFOUND) for an unknown name
+	const std::string& sql(const std::string& name) const {
+		const auto it = m_index.find(name);
+		if (it == m_index.end()) {
+			throw sql_error(SQLITE_NOTFOUND, "no statement \"" + name + "\" is registered");
+		}
+		return m_entries[it->second].sql;
+	}
+
+	inline const std::vector<entry>& entries() const noexcept { return m_entries; }
+	inline const std::vector<std::string>& hot_tables() const noexcept { return m_hot; }
+	inline std::size_t size() const noexcept { return m_entries.size(); }
 
 	private:
-	bool m_saw_error;
-	boost::optional<sql_error> m_err;
-	
-	sql_result(int _value) : value(std::move(_value)), m_saw_error(true) {}
-	sql_result(int _value, sql_error err) : value(std::move(_value)), m_saw_error(false),m_err(std::move(err)) {}
+	std::vector<entry> m_entries;
+	std::unordered_map<std::string, std::size_t> m_index;
+	std::vector<std::string> m_hot;
+};
+
+namespace detail {
+
+	// the signature of a function object, function pointer or member function
+	template<typename F>
+	struct callable_traits : callable_traits<decltype(&F::operator())> {};
+
+	template<typename R, typename... Args>
+	struct callable_traits<R (*)(Args...)> {
+		using result = R;
+		using arguments = std::tuple<typename std::decay<Args>::type...>;
+		static constexpr std::size_t arity = sizeof...(Args);
+	};
+
+	template<typename C, typename R, typename... Args>
+	struct callable_traits<R (C::*)(Args...)> : callable_traits<R (*)(Args...)> {};
+
+	template<typename C, typename R, typename... Args>
+	struct callable_traits<R (C::*)(Args...) const> : callable_traits<R (*)(Args...)> {};
+
+	// converts a SQL function argument; views live until the function returns
+	template<typename T>
+	struct function_arg;
+
+	template<>
+	struct function_arg<int32_t> {
+		static int32_t get(sqlite3_value* v) noexcept { return sqlite3_value_int(v); }
+	};
+
+	template<>
+	struct function_arg<int64_t> {
+		static int64_t get(sqlite3_value* v) noexcept { return sqlite3_value_int64(v); }
+	};
+
+	template<>
+	struct function_arg<double> {
+		static double get(sqlite3_value* v) noexcept { return sqlite3_value_double(v); }
+	};
+
+	template<>
+	struct function_arg<bool> {
+		static bool get(sqlite3_value* v) noexcept { return sqlite3_value_int(v) != 0; }
+	};
+
+	template<>
+	struct function_arg<text_view> {
+		static text_view get(sqlite3_value* v) noexcept {
+			const auto data = reinterpret_cast<const char*>(sqlite3_value_text(v));
+			if (data == nullptr) {
+				return text_view{"", 0};
+			}
+			return text_view{data, static_cast<std::size_t>(sqlite3_value_bytes(v))};
+		}
+	};
+
+	template<>
+	struct function_arg<std::string> {
+		static std::string get(sqlite3_value* v) { return function_arg<text_view>::get(v).str(); }
+	};
+
+	template<>
+	struct function_arg<blob_view> {
+		static blob_view get(sqlite3_value* v) noexcept {
+			const auto data = sqlite3_value_blob(v);
+			if (data == nullptr) {
+				return blob_view{nullptr, 0};
+			}
+			return blob_view{data, static_cast<std::size_t>(sqlite3_value_bytes(v))};
+		}
+	};
+
+	// the raw value, e.g. to look at its type
+	template<>
+	struct function_arg<sqlite3_value*> {
+		static sqlite3_value* get(sqlite3_value* v) noexcept { return v; }
+	};
+
+	inline void function_result(sqlite3_context* ctx, int32_t value) noexcept { sqlite3_result_int(ctx, value); }
+	inline void function_result(sqlite3_context* ctx, int64_t value) noexcept { sqlite3_result_int64(ctx, value); }
+	inline void function_result(sqlite3_context* ctx, double value) noexcept { sqlite3_result_double(ctx, value); }
+	inline void function_result(sqlite3_context* ctx, bool value) noexcept { sqlite3_result_int(ctx, value ? 1 : 0); }
+	inline void function_result(sqlite3_context* ctx, std::nullptr_t) noexcept { sqlite3_result_null(ctx); }
+
+	inline void function_result(sqlite3_context* ctx, const std::string& value) noexcept {
+		sqlite3_result_text(ctx, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+	}
+
+	inline void function_result(sqlite3_context* ctx, const text_view& value) noexcept {
+		sqlite3_result_text(ctx, value.data, static_cast<int>(value.size), SQLITE_TRANSIENT);
+	}
+
+	inline void function_result(sqlite3_context* ctx, const blob_view& value) noexcept {
+		sqlite3_result_blob(ctx, value.data, static_cast<int>(value.size), SQLITE_TRANSIENT);
+	}
+
+	inline void function_result(sqlite3_context* ctx, sqlite3_value* value) noexcept { sqlite3_result_value(ctx, value); }
+
+	// exceptions must not unwind into SQLite
+	template<typename F>
+	void guarded(sqlite3_context* ctx, F&& f) noexcept {
+		try {
+			f();
+		} catch (const sql_error& e) {
+			sqlite3_result_error(ctx, e.message.c_str(), -1);
+			sqlite3_result_error_code(ctx, e.code);
+		} catch (const std::bad_alloc&) {
+			sqlite3_result_error_nomem(ctx);
+		} catch (const std::exception& e) {
+			sqlite3_result_error(ctx, e.what(), -1);
+		} catch (...) {
+			sqlite3_result_error(ctx, "unknown exception in SQL function", -1);
+		}
+	}
+
+	template<typename F, std::size_t... I>
+	inline auto invoke_with_values(F& f, sqlite3_value** argv, indices<I...>)
+		-> typename callable_traits<F>::result {
+		using args = typename callable_traits<F>::arguments;
+		return f(function_arg<typename std::tuple_element<I, args>::type>::get(argv[I])...);
+	}
+
+	template<typename F>
+	struct scalar_function {
+		static void call(sqlite3_context* ctx, int, sqlite3_value** argv) noexcept {
+			auto& f = *static_cast<F*>(sqlite3_user_data(ctx));
+			guarded(ctx, [&] {
+				using seq = typename make_indices<callable_traits<F>::arity>::type;
+				function_result(ctx, invoke_with_values(f, argv, seq()));
+			});
+		}
+
+		static void destroy(void* f) noexcept { delete static_cast<F*>(f); }
+	};
+
+	/*
+	 * One State per group, created on the first step() and destroyed after
+	 * result(). An empty group gets a fresh State just for result().
+	 */
+	template<typename State>
+	struct aggregate_function {
+		using step_traits = callable_traits<decltype(&State::step)>;
+
+		static State** slot(sqlite3_context* ctx, bool create) noexcept {
+			return static_cast<State**>(sqlite3_aggregate_context(ctx, create ? sizeof(State*) : 0));
+		}
 
+		static void step(sqlite3_context* ctx, int, sqlite3_value** argv) noexcept {
+			guarded(ctx, [&] {
+				const auto s = slot(ctx, true);
+				if (s == nullptr) {
+					throw std::bad_alloc();
+				}
+				if (*s == nullptr) {
+					*s = new State();
+				}
+				step_with(**s, argv, typename make_indices<step_traits::arity>::type());
+			});
+		}
+
+		static void finish(sqlite3_context* ctx) noexcept {
+			const auto s = slot(ctx, false);
+			std::unique_ptr<State> state(s != nullptr ? *s : nullptr);
+			guarded(ctx, [&] {
+				if (!state) {
+					state.reset(new State());
+				}
+				function_result(ctx, state->result());
+			});
+		}
+
+		template<std::size_t... I>
+		static void step_with(State& state, sqlite3_value** argv, indices<I...>) {
+			using args = typename step_traits::arguments;
+			state.step(function_arg<typename std::tuple_element<I, args>::type>::get(argv[I])...);
+		}
+	};
+
+} /* namespace detail */
+
+/*
+ * How a connection waits for a lock held by another connection: sleep
+ * initial_delay, growing by multiplier up to max_delay, each sleep cut
+ * short at random by up to jitter (a fraction) so that waiters spread
+ * out. After deadline the statement fails with SQLITE_BUSY.
+ */
+struct busy_policy {
+	std::chrono::microseconds initial_delay{100};
+	std::chrono::microseconds max_delay{20000};
+	double multiplier = 2.0;
+	double jitter = 0.5;
+	std::chrono::milliseconds deadline{5000};
+};
+
+struct busy_stats {
+	uint64_t waits = 0;     // times a lock was found busy
+	uint64_t retries = 0;   // sleeps taken before trying again
+	uint64_t timeouts = 0;  // waits that hit the deadline
+	uint64_t wait_ns = 0;   // time spent asleep
 };
 
+namespace detail {
+
+	struct busy_state {
+		busy_policy policy;
+		busy_stats stats;
+		std::chrono::steady_clock::time_point started;
+		std::minstd_rand random{static_cast<std::minstd_rand::result_type>(
+			std::chrono::steady_clock::now().time_since_epoch().count())};
+
+		static int handler(void* self, int attempt) noexcept {
+			return static_cast<busy_state*>(self)->wait(attempt);
+		}
+
+		int wait(int attempt) noexcept {
+			const auto now = std::chrono::steady_clock::now();
+			if (attempt == 0) {
+				started = now;
+				++stats.waits;
+			}
+			auto delay = static_cast<double>(policy.initial_delay.count()) * std::pow(policy.multiplier, attempt);
+			delay = std::min(delay, static_cast<double>(policy.max_delay.count()));
+			if (policy.jitter > 0) {
+				delay *= 1.0 - policy.jitter * std::uniform_real_distribution<double>(0.0, 1.0)(random);
+			}
+			const auto sleep = std::chrono::microseconds(static_cast<int64_t>(delay));
+			if (now - started + sleep > policy.deadline) {
+				++stats.timeouts;
+				return 0;
+			}
+			std::this_thread::sleep_for(sleep);
+			++stats.retries;
+			stats.wait_ns += static_cast<uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - now).count());
+			return 1;
+		}
+	};
+
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+	struct unlock_counters {
+		std::atomic<uint64_t> waits{0};
+		std::atomic<uint64_t> wait_ns{0};
+	};
+
+	inline unlock_counters& unlock_stats() noexcept {
+		static unlock_counters counters;
+		return counters;
+	}
+
+	struct unlock_waiter {
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool fired = false;
+
+		static void notify(void** waiters, int count) noexcept {
+			for (int i = 0; i < count; ++i) {
+				auto& w = *static_cast<unlock_waiter*>(waiters[i]);
+				std::lock_guard<std::mutex> lock(w.mutex);
+				w.fired = true;
+				w.cv.notify_one();
+			}
+		}
+	};
+
+	// blocks until the connection holding the shared-cache lock commits
+	inline int wait_for_unlock(sqlite3* db) {
+		unlock_waiter w;
+		const auto start = std::chrono::steady_clock::now();
+		// SQLITE_LOCKED here means waiting would deadlock
+		const int r = sqlite3_unlock_notify(db, &unlock_waiter::notify, &w);
+		if (r == SQLITE_OK) {
+			std::unique_lock<std::mutex> lock(w.mutex);
+			w.cv.wait(lock, [&w] { return w.fired; });
+		}
+		auto& counters = unlock_stats();
+		++counters.waits;
+		counters.wait_ns += static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		return r;
+	}
+#endif
+
+} /* namespace detail */
+
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+// process-wide totals of statement::step_blocking() waits
+inline busy_stats unlock_notify_stats() noexcept {
+	busy_stats result;
+	result.waits = detail::unlock_stats().waits.load();
+	result.wait_ns = detail::unlock_stats().wait_ns.load();
+	return result;
+}
+#endif
+
+struct cached_statement;
+
 struct connection {
 
 	connection_handle handle;
 
+	connection() = default;
+	connection(connection&&) = default;
+
+	// the cache has to go first, its statements keep the old database busy
+	connection& operator=(connection&& rhs) {
+		m_cache = std::move(rhs.m_cache);
+		handle = std::move(rhs.handle);
+		m_busy = std::move(rhs.m_busy);
+		return *this;
+	}
+
 	static inline connection create(const char *connection_string) {
 		connection result;
-		result.open(connection_string);
+		result.open(connection_string).check();
+		return result;
+	}
+
+	static inline connection create(const char *connection_string, const connection_options& options) {
+		connection result;
+		result.open(connection_string, options).check();
+		result.configure(options);
 		return result;
 	}
 
 	static inline connection create_memory() {
 		connection result;
-		result.open(":memory:");
+		result.open(":memory:").check();
 		return result;
 	}
 
 
+	// throws sql_error on failure, try_execute() leaves that to the caller
 	inline sql_result execute(const std::string& str) const {
+		return try_execute(str).check();
+	}
+
+	inline sql_result try_execute(const std::string& str) const {
 		const auto r = sqlite3_exec(handle.get(), str.c_str(), nullptr, nullptr, nullptr);
 		return sql_result::from_cmd(r, handle);
 	}
@@ -165,10 +835,179 @@ struct connection {
 	sql_result open(const std::string& filename) {
 		auto local = connection_handle{};
 		auto const r = sqlite3_open(filename.c_str(), local.get_address_of());
+		cache().clear();
+		handle = std::move(local);
+		return sql_result::from_cmd(r, handle);
+	}
+
+	sql_result open(const std::string& filename, const connection_options& options) {
+		auto local = connection_handle{};
+		auto const r = sqlite3_open_v2(filename.c_str(), local.get_address_of(), options.flags, options.vfs);
+		cache().clear();
 		handle = std::move(local);
 		return sql_result::from_cmd(r, handle);
 	}
 
+	// applies the PRAGMA part of options to an open connection
+	void configure(const connection_options& options) {
+		static const char* const journal_modes[] = {"", "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"};
+		static const char* const sync_modes[] = {"", "OFF", "NORMAL", "FULL"};
+		static const char* const temp_modes[] = {"", "FILE", "MEMORY"};
+
+		if (options.lookaside_size > 0) {
+			configure_lookaside(options.lookaside_size, options.lookaside_count);
+		}
+		if (options.busy_timeout > 0) {
+			sql_result::from_cmd(sqlite3_busy_timeout(handle.get(), options.busy_timeout), handle).check();
+		}
+		if (options.journal != JOURNAL_DEFAULT && (options.flags & SQLITE_OPEN_READONLY) == 0) {
+			execute(std::string("PRAGMA journal_mode=") + journal_modes[options.journal]);
+		}
+		if (options.synchronous != SYNC_DEFAULT) {
+			execute(std::string("PRAGMA synchronous=") + sync_modes[options.synchronous]);
+		}
+		if (options.temp_store != TEMP_DEFAULT) {
+			execute(std::string("PRAGMA temp_store=") + temp_modes[options.temp_store]);
+		}
+		if (options.mmap_size >= 0) {
+			execute("PRAGMA mmap_size=" + std::to_string(options.mmap_size));
+		}
+		if (options.cache_size != 0) {
+			execute("PRAGMA cache_size=" + std::to_string(options.cache_size));
+		}
+	}
+
+	// only takes effect while no lookaside memory is in use, i.e. right after open
+	void configure_lookaside(int slot_size, int slot_count) {
+		const auto r = sqlite3_db_config(handle.get(), SQLITE_DBCONFIG_LOOKASIDE, nullptr, slot_size, slot_count);
+		sql_result::from_cmd(r, handle).check();
+	}
+
+	/*
+	 * Replaces the busy handler (and any busy_timeout) with policy. The
+	 * counters start from zero whenever a policy is set.
+	 */
+	void set_busy_policy(const busy_policy& policy) {
+		if (!m_busy) {
+			m_busy.reset(new detail::busy_state());
+		}
+		m_busy->policy = policy;
+		m_busy->stats = busy_stats();
+		const auto r = sqlite3_busy_handler(handle.get(), &detail::busy_state::handler, m_busy.get());
+		sql_result::from_cmd(r, handle).check();
+	}
+
+	// all zero without a busy policy
+	busy_stats get_busy_stats(bool reset = false) noexcept {
+		if (!m_busy) {
+			return busy_stats();
+		}
+		const auto result = m_busy->stats;
+		if (reset) {
+			m_busy->stats = busy_stats();
+		}
+		return result;
+	}
+
+	// reset starts the next interval for the counters and high-water marks
+	connection_stats stats(bool reset = false) const {
+		const auto db = handle.get();
+		connection_stats result;
+		detail::read_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &result.cache_used, nullptr, false);
+		detail::read_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &result.cache_hit, nullptr, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &result.cache_miss, nullptr, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_CACHE_WRITE, &result.cache_write, nullptr, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_USED, &result.lookaside_used, &result.lookaside_highwater, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, nullptr, &result.lookaside_hit, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, nullptr, &result.lookaside_miss_size, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, nullptr, &result.lookaside_miss_full, reset);
+		detail::read_db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, &result.schema_used, nullptr, false);
+		detail::read_db_status(db, SQLITE_DBSTATUS_STMT_USED, &result.stmt_used, nullptr, false);
+		result.memory = memory_status();
+		return result;
+	}
+
+	/*
+	 * Registers f as the SQL function name. Arguments and the result are
+	 * converted according to f's signature (int32_t, int64_t, double,
+	 * bool, std::string, text_view, blob_view, sqlite3_value*; results
+	 * also std::nullptr_t). Deterministic functions can be factored out of
+	 * loops by the planner and used in indexes. Exceptions become SQL errors.
+	 *
+	 *	c.create_function("haversine", [](double a, double b, double c, double d) { ... });
+	 */
+	template<typename F>
+	void create_function(const std::string& name, F f, bool deterministic = true) {
+		using function = detail::scalar_function<F>;
+		const int arity = static_cast<int>(detail::callable_traits<F>::arity);
+		std::unique_ptr<F> data(new F(std::move(f)));
+		const auto r = sqlite3_create_function_v2(handle.get(), name.c_str(), arity, function_flags(deterministic),
+							  data.get(), &function::call, nullptr, nullptr, &function::destroy);
+		// on failure SQLite has already called destroy
+		data.release();
+		sql_result::from_cmd(r, handle).check();
+	}
+
+	/*
+	 * Registers the aggregate name over a default-constructible State with
+	 * step(Args...) called per row and result() for the group's value.
+	 *
+	 *	struct median { std::vector<double> v; void step(double x); double result(); };
+	 *	c.create_aggregate<median>("median");
+	 */
+	template<typename State>
+	void create_aggregate(const std::string& name, bool deterministic = true) {
+		using function = detail::aggregate_function<State>;
+		const int arity = static_cast<int>(function::step_traits::arity);
+		const auto r = sqlite3_create_function_v2(handle.get(), name.c_str(), arity, function_flags(deterministic),
+							  nullptr, nullptr, &function::step, &function::finish, nullptr);
+		sql_result::from_cmd(r, handle).check();
+	}
+
+	// checks a reset statement out of the cache, preparing it on a miss
+	inline cached_statement prepare_cached(const std::string& sql);
+
+	/*
+	 * Loads the schema and prepares every statement of registry into the
+	 * statement cache, which grows by the registry's size if they would
+	 * not fit next to what it holds already. The first statement that does
+	 * not compile throws an sql_error naming it. With warm_pages the hot
+	 * tables and their indexes are read through once, so their pages are
+	 * in the page cache (which should be large enough to keep them); an
+	 * index that can't be read in order, as a partial one, is skipped.
+	 * SQLite cannot persist prepared statements, so this runs once per
+	 * connection and process.
+	 */
+	inline void warmup(const statement_registry& registry, bool warm_pages = true);
+
+	// a moved-from connection gets a new, empty cache when it is used again
+	inline statement_cache& cache() {
+		if (!m_cache) {
+			m_cache.reset(new statement_cache());
+		}
+		return *m_cache;
+	}
+
+	inline const statement_cache& cache() const {
+		static const statement_cache empty(0);
+		return m_cache ? *m_cache : empty;
+	}
+
+	private:
+	static inline int function_flags(bool deterministic) noexcept {
+		return SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0);
+	}
+
+	// on the heap so that cached statements can find it after a move, null once moved from
+	std::unique_ptr<statement_cache> m_cache{new statement_cache()};
+	// SQLite keeps a pointer to it
+	std::unique_ptr<detail::busy_state> m_busy;
+
+};
+
+// a statement parameter resolved by name, see statement::find_parameter()
+struct parameter {
+	int index;
 };
 
 struct statement {
@@ -177,7 +1016,7 @@ struct statement {
 	template<typename Connection>
 	static inline statement create(Connection&& c, std::string sql) {
 		statement result;
-		result.prepare(std::forward<Connection>(c), std::move(sql));
+		result.prepare(std::forward<Connection>(c), std::move(sql)).check();
 		return result;
 	}
 
@@ -186,7 +1025,8 @@ struct statement {
 	sql_result prepare(Connection&& c, const std::string& text) {
 		handle.reset();
 		const auto r = sqlite3_prepare_v2(c.handle.get(), text.c_str(), text.size(), handle.get_address_of(), nullptr);
-		return sql_result::from_cmd(r, handle);
+		// a failed prepare leaves no statement to take the message from
+		return sql_result::from_cmd(r, c.handle);
 	}
 	
 
@@ -195,12 +1035,30 @@ struct statement {
 		return std::string(sqlite3_errmsg(sqlite3_db_handle(handle.get())));
 	}		
 
+	// create_binding() reports failures, bind() throws them
 	template<typename T>
 	statement& bind(const int index, const T& value) {
-		create_binding(index, value);
+		create_binding(index, value).check();
+		return *this;
+	}
+
+	template<typename T>
+	statement& bind(const parameter p, const T& value) {
+		create_binding(p.index, value).check();
 		return *this;
 	}
 
+	// looks up ":name", "@name" or "$name" once, to bind by index afterwards
+	parameter find_parameter(const char* name) const {
+		const int index = sqlite3_bind_parameter_index(handle.get(), name);
+		if (index == 0) {
+			throw sql_error(SQLITE_RANGE, std::string("no such parameter: ") + name);
+		}
+		return parameter{index};
+	}
+
+	inline int parameter_count() const noexcept { return sqlite3_bind_parameter_count(handle.get()); }
+
 	inline sql_result create_binding(const int index, const unsigned int value) {
 		const int r = sqlite3_bind_int(handle.get(), index, value);
 		return sql_result::from_cmd(r, handle);
@@ -232,11 +1090,16 @@ struct statement {
 		return sql_result::from_cmd(r, handle);
 	}
 
+	inline sql_result create_binding(const int index, std::nullptr_t) {
+		return create_binding(index);
+	}
+
 	inline sql_result create_binding(const int index, sqlite3_value *value) {
 		const int r = sqlite3_bind_value(handle.get(), index, value);
 		return sql_result::from_cmd(r, handle);
 	}
 
+	// measures value with strlen; bind a text_view when the length is known
 	inline sql_result create_binding(int const index, const char* value) {
 		const int r = sqlite3_bind_text(handle.get(), index, value, strlen(value), SQLITE_STATIC);
 		return sql_result::from_cmd(r, handle);
@@ -248,6 +1111,17 @@ struct statement {
 		return sql_result::from_cmd(r, handle);
 	}
 
+	// the view is bound in place (SQLITE_STATIC) and must outlive the step
+	inline sql_result create_binding(int const index, const text_view& value) {
+		const int r = sqlite3_bind_text(handle.get(), index, value.data, static_cast<int>(value.size), SQLITE_STATIC);
+		return sql_result::from_cmd(r, handle);
+	}
+
+	inline sql_result create_binding(int const index, const blob_view& value) {
+		const int r = sqlite3_bind_blob(handle.get(), index, value.data, static_cast<int>(value.size), SQLITE_STATIC);
+		return sql_result::from_cmd(r, handle);
+	}
+
 	inline sql_result create_binding_zeroblob(const int index, int size) {
 		const int r = sqlite3_bind_zeroblob(handle.get(), index, size);
 		return sql_result::from_cmd(r, handle);
@@ -269,35 +1143,357 @@ struct statement {
 		return sql_result::from_cmd(r, handle);
 	}
 
+	// binds the tuple elements to parameters first, first + 1, ...
+	template<typename... T>
+	statement& bind_tuple(const std::tuple<T...>& values, const int first = 1) {
+		detail::tuple_binder<0, sizeof...(T)>::bind(*this, values, first);
+		return *this;
+	}
+
 	inline void reset_binding() {
 		 sqlite3_reset(handle.get());
 		 sqlite3_clear_bindings(handle.get());
 	}
 
 	inline const statement& step_dirty() {
-		const auto result = sql_result::from_stmt(sqlite3_step(handle.get()), handle);
+		try_step().check();
 		return *this;
 	}
 
+	// throws sql_error on anything but SQLITE_ROW/SQLITE_DONE
 	inline sql_result step() const {
+		return try_step().check();
+	}
+
+	inline sql_result try_step() const {
 		const int r = sqlite3_step(handle.get());
 		return sql_result::from_stmt(r, handle);
+	}
+
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+	/*
+	 * For shared-cache connections: instead of failing with
+	 * SQLITE_LOCKED_SHAREDCACHE, sleeps in sqlite3_unlock_notify until the
+	 * blocking connection finishes its transaction and steps again. The
+	 * blocker must run on another thread, or this waits forever; a wait
+	 * that SQLite sees would deadlock returns SQLITE_LOCKED.
+	 */
+	inline sql_result try_step_blocking() const {
+		const auto stmt = handle.get();
+		const auto db = sqlite3_db_handle(stmt);
+		for (;;) {
+			const int r = sqlite3_step(stmt);
+			if (r != SQLITE_LOCKED || sqlite3_extended_errcode(db) != SQLITE_LOCKED_SHAREDCACHE) {
+				return sql_result::from_stmt(r, handle);
+			}
+			const int w = detail::wait_for_unlock(db);
+			if (w != SQLITE_OK) {
+				return sql_result::from_stmt(w, handle);
+			}
+			sqlite3_reset(stmt);
+		}
+	}
 
+	inline sql_result step_blocking() const {
+		return try_step_blocking().check();
 	}
+#endif
 
 	inline int64_t rowid() const { return sqlite3_last_insert_rowid(sqlite3_db_handle(handle.get())); }
 	inline int64_t get_int64(const int column = 1) const { return sqlite3_column_int64(handle.get(), column); }
 	inline int32_t get_int(const int column = 1) const { return sqlite3_column_int(handle.get(), column); }
 	inline double  get_double(const int column = 1) const { return sqlite3_column_double(handle.get(), column); }
-	inline std::string get_string(const int column = 1) const { return std::string(reinterpret_cast<const char*>(sqlite3_column_text(handle.get(), column))); }
+	inline std::string get_string(const int column = 1) const { return get_text(column).str(); }
 	inline sqlite3_value* get_value(const int column = 1) const { return sqlite3_column_value(handle.get(), column); }
 	inline datatype get_type(const int column = 1) const { return static_cast<datatype>(sqlite3_column_type(handle.get(), column)); }
 
+	// NULL comes back as an empty view; the size has to be read after the pointer
+	inline text_view get_text(const int column = 1) const {
+		const auto data = reinterpret_cast<const char*>(sqlite3_column_text(handle.get(), column));
+		if (data == nullptr) {
+			return text_view{"", 0};
+		}
+		return text_view{data, static_cast<std::size_t>(sqlite3_column_bytes(handle.get(), column))};
+	}
+
+	inline blob_view get_blob(const int column = 1) const {
+		const auto data = sqlite3_column_blob(handle.get(), column);
+		if (data == nullptr) {
+			return blob_view{nullptr, 0};
+		}
+		return blob_view{data, static_cast<std::size_t>(sqlite3_column_bytes(handle.get(), column))};
+	}
+};
+
+/*
+ * A statement borrowed from connection::prepare_cached(). It goes back into
+ * the connection's cache when it is destroyed, so it must not outlive the
+ * connection.
+ */
+struct cached_statement : statement {
+
+	cached_statement(statement_cache& cache, std::string sql, statement_handle stmt)
+	: m_cache(&cache), m_sql(std::move(sql)) {
+		handle = std::move(stmt);
+	}
+
+	cached_statement(cached_statement&& rhs) : m_cache(rhs.m_cache), m_sql(std::move(rhs.m_sql)) {
+		handle = std::move(rhs.handle);
+		rhs.m_cache = nullptr;
+	}
+
+	cached_statement& operator=(cached_statement&& rhs) {
+		if (this != &rhs) {
+			give_back();
+			m_cache = rhs.m_cache;
+			m_sql = std::move(rhs.m_sql);
+			handle = std::move(rhs.handle);
+			rhs.m_cache = nullptr;
+		}
+		return *this;
+	}
+
+	~cached_statement() { give_back(); }
+
+	inline const std::string& sql() const noexcept { return m_sql; }
+
+	private:
+	statement_cache* m_cache;
+	std::string m_sql;
+
+	void give_back() noexcept {
+		if (m_cache != nullptr && handle) {
+			m_cache->release(m_sql, std::move(handle));
+		}
+		m_cache = nullptr;
+	}
+};
+
+inline cached_statement connection::prepare_cached(const std::string& sql) {
+	auto& statements = cache();
+	auto stmt = statements.acquire(sql);
+	if (!stmt) {
+		const auto r = sqlite3_prepare_v2(handle.get(), sql.c_str(), sql.size(), stmt.get_address_of(), nullptr);
+		sql_result::from_cmd(r, handle).check();
+	}
+	return cached_statement(statements, sql, std::move(stmt));
+}
+
+inline void connection::warmup(const statement_registry& registry, bool warm_pages) {
+	execute("SELECT count(*) FROM sqlite_master");
+	auto& statements = cache();
+	// headroom, so the first statement outside the registry doesn't evict a warm one
+	if (statements.capacity() < statements.size() + registry.size()) {
+		statements.set_capacity(statements.capacity() + registry.size());
+	}
+	for (const auto& e : registry.entries()) {
+		auto stmt = statements.acquire(e.sql);
+		if (!stmt) {
+			const auto r = sqlite3_prepare_v2(handle.get(), e.sql.c_str(), e.sql.size(), stmt.get_address_of(), nullptr);
+			if (r != SQLITE_OK) {
+				throw sql_error(r, "statement \"" + e.name + "\" does not compile: " + get_current_error());
+			}
+		}
+		statements.release(e.sql, std::move(stmt));
+	}
+	if (!warm_pages) {
+		return;
+	}
+	const auto read_all = [this](const std::string& sql) {
+		auto stmt = statement::create(*this, sql);
+		while (stmt.step().has_data()) {
+		}
+	};
+	for (const auto& table : registry.hot_tables()) {
+		// NOT INDEXED walks the table b-tree itself, count(*) would pick an index
+		read_all("SELECT 1 FROM " + detail::quote_identifier(table) + " NOT INDEXED");
+		auto indexes = statement::create(*this, "PRAGMA index_list(" + detail::quote_identifier(table) + ")");
+		while (indexes.step().has_data()) {
+			// column 4 is "partial" from SQLite 3.8.9 on; before, the query below fails for those
+			if (sqlite3_column_count(indexes.handle.get()) > 4 && indexes.get_int(4) != 0) {
+				continue;
+			}
+			const std::string index = indexes.get_text(1).str();
+			try {
+				auto columns = statement::create(*this, "PRAGMA index_info(" + detail::quote_identifier(index) + ")");
+				if (columns.step().has_data()) {
+					read_all("SELECT 1 FROM " + detail::quote_identifier(table) + " INDEXED BY "
+						 + detail::quote_identifier(index) + " ORDER BY "
+						 + detail::quote_identifier(columns.get_text(2).str()));
+				}
+			} catch (const sql_error&) {
+				// only a hint: an index that can't be warmed stays cold
+			}
+		}
+	}
+}
+
+namespace detail {
 
+	// binds element I.. of a tuple to the parameters in indexes[I]..
+	template<typename Tuple, typename Indexes, std::size_t... I>
+	inline void bind_at(statement& stmt, const Tuple& values, const Indexes& indexes, indices<I...>) {
+		const int ignored[] = {0, (stmt.create_binding(indexes[I], std::get<I>(values)).check(), 0)...};
+		(void)ignored;
+	}
+
+} /* namespace detail */
+
+/*
+ * Values for a statement's parameters, kept between rows so a hot loop only
+ * assigns the fields that change and binds them all with one call. Names
+ * are resolved once against a statement with the same SQL; without names
+ * the values go to parameters 1..N. Strings are bound in place, so the
+ * block must not change between bind() and the step.
+ *
+ *	parameter_block<int64_t, std::string> row(insert, {":id", ":name"});
+ *	for (...) { row.get<0>() = id; row.get<1>() = name; row.bind(insert); insert.step(); insert.reset_binding(); }
+ */
+template<typename... T>
+struct parameter_block {
+	std::tuple<T...> values;
+
+	parameter_block() {
+		for (std::size_t i = 0; i < sizeof...(T); ++i) {
+			m_indexes[i] = static_cast<int>(i + 1);
+		}
+	}
+
+	parameter_block(const statement& stmt, std::initializer_list<const char*> names) {
+		if (names.size() != sizeof...(T)) {
+			throw sql_error(SQLITE_MISUSE, "parameter_block: names do not match the value types");
+		}
+		std::size_t i = 0;
+		for (const auto name : names) {
+			m_indexes[i++] = stmt.find_parameter(name).index;
+		}
+	}
 
-	//not sure what i should do with them.
-	//int sqlite3_column_bytes(sqlite3_stmt*, int iCol);
-	//const void *sqlite3_column_blob(sqlite3_stmt*, int iCol);
+	template<std::size_t I>
+	inline typename std::tuple_element<I, std::tuple<T...>>::type& get() noexcept { return std::get<I>(values); }
+
+	template<std::size_t I>
+	inline const typename std::tuple_element<I, std::tuple<T...>>::type& get() const noexcept { return std::get<I>(values); }
+
+	void set(const T&... v) { values = std::tuple<T...>(v...); }
+
+	void bind(statement& stmt) const {
+		detail::bind_at(stmt, values, m_indexes, typename detail::make_indices<sizeof...(T)>::type());
+	}
+
+	inline int index(std::size_t i) const noexcept { return m_indexes[i]; }
+
+	private:
+	int m_indexes[sizeof...(T) == 0 ? 1 : sizeof...(T)];
+};
+
+enum transaction_mode {
+	TRANSACTION_DEFERRED,
+	TRANSACTION_IMMEDIATE, // takes the write lock up front, no lock upgrade later
+	TRANSACTION_EXCLUSIVE
+};
+
+namespace detail {
+
+	inline void run_cached(connection& c, const std::string& sql) {
+		c.prepare_cached(sql).step();
+	}
+
+	inline void run_cached_noexcept(connection& c, const std::string& sql) noexcept {
+		try {
+			c.prepare_cached(sql).try_step();
+		} catch (...) {
+		}
+	}
+
+} /* namespace detail */
+
+/*
+ * Scoped BEGIN ... COMMIT. Until commit() succeeds the destructor rolls the
+ * transaction back, so an exception unwinding past the guard undoes it. The
+ * BEGIN/COMMIT/ROLLBACK statements come from the connection's cache.
+ */
+struct transaction {
+
+	explicit transaction(connection& c, transaction_mode mode = TRANSACTION_DEFERRED) : m_conn(&c) {
+		static const char* const begin[] = {"BEGIN DEFERRED", "BEGIN IMMEDIATE", "BEGIN EXCLUSIVE"};
+		detail::run_cached(c, begin[mode]);
+	}
+
+	transaction(transaction&& rhs) noexcept : m_conn(rhs.m_conn) { rhs.m_conn = nullptr; }
+
+	transaction(const transaction&) = delete;
+	transaction& operator=(const transaction&) = delete;
+	transaction& operator=(transaction&&) = delete;
+
+	~transaction() {
+		if (m_conn != nullptr) {
+			detail::run_cached_noexcept(*m_conn, "ROLLBACK");
+		}
+	}
+
+	// a failed COMMIT (e.g. SQLITE_BUSY) leaves the transaction open
+	void commit() {
+		detail::run_cached(*m_conn, "COMMIT");
+		m_conn = nullptr;
+	}
+
+	void rollback() {
+		detail::run_cached(*m_conn, "ROLLBACK");
+		m_conn = nullptr;
+	}
+
+	inline bool active() const noexcept { return m_conn != nullptr; }
+
+	private:
+	connection* m_conn;
+};
+
+/*
+ * Scoped SAVEPOINT, which nests inside a transaction or another savepoint.
+ * release() keeps the changes; otherwise the destructor rolls back to the
+ * savepoint and releases it.
+ */
+struct savepoint {
+
+	explicit savepoint(connection& c, const std::string& name = "sqlitepp11")
+	: m_conn(&c), m_name(name), m_quoted(detail::quote_identifier(name)) {
+		detail::run_cached(c, "SAVEPOINT " + m_quoted);
+	}
+
+	savepoint(savepoint&& rhs) noexcept : m_conn(rhs.m_conn), m_name(std::move(rhs.m_name)), m_quoted(std::move(rhs.m_quoted)) {
+		rhs.m_conn = nullptr;
+	}
+
+	savepoint(const savepoint&) = delete;
+	savepoint& operator=(const savepoint&) = delete;
+	savepoint& operator=(savepoint&&) = delete;
+
+	~savepoint() {
+		if (m_conn != nullptr) {
+			detail::run_cached_noexcept(*m_conn, "ROLLBACK TO " + m_quoted);
+			detail::run_cached_noexcept(*m_conn, "RELEASE " + m_quoted);
+		}
+	}
+
+	void release() {
+		detail::run_cached(*m_conn, "RELEASE " + m_quoted);
+		m_conn = nullptr;
+	}
+
+	void rollback() {
+		detail::run_cached(*m_conn, "ROLLBACK TO " + m_quoted);
+		detail::run_cached(*m_conn, "RELEASE " + m_quoted);
+		m_conn = nullptr;
+	}
+
+	inline bool active() const noexcept { return m_conn != nullptr; }
+	inline const std::string& name() const noexcept { return m_name; }
+
+	private:
+	connection* m_conn;
+	std::string m_name;
+	std::string m_quoted;
 };
 
 } /* namespace sqlite  */
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "../async.hpp"
+
+namespace {
+
+int count(sqlite::connection& c, const std::string& sql) {
+	auto s = sqlite::statement::create(c, sql);
+	s.step();
+	return s.get_int(0);
+}
+
+template<typename T>
+int error_code(std::future<T>& f) {
+	try {
+		f.get();
+	} catch (const sqlite::sql_error& e) {
+		return e.code;
+	}
+	return SQLITE_OK;
+}
+
+} /* namespace */
+
+int main() {
+	run("reads and writes", [] {
+		sqlite::async_connection db([] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE t (x INTEGER)");
+			return c;
+		});
+		std::vector<std::future<void>> writes;
+		for (int i = 0; i < 100; ++i) {
+			writes.push_back(db.write([i](sqlite::connection& c) { c.execute("INSERT INTO t VALUES (" + std::to_string(i) + ")"); }));
+		}
+		auto n = db.read([](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t"); });
+		CHECK(n.get() == 100);
+		for (auto& w : writes) {
+			CHECK(error_code(w) == SQLITE_OK);
+		}
+		CHECK(db.writes_committed() == 100);
+		CHECK(db.batches_committed() >= 1 && db.batches_committed() <= 100);
+	});
+
+	// holds the worker on a read until the writes behind it are queued, so they form one batch
+	const auto batched = [](sqlite::async_connection& db, std::vector<std::string> sql) {
+		std::promise<void> gate;
+		auto open = gate.get_future().share();
+		auto hold = db.read([open](sqlite::connection&) { open.wait(); });
+		std::vector<std::future<void>> result;
+		for (const auto& s : sql) {
+			result.push_back(db.write([s](sqlite::connection& c) { c.execute(s); }));
+		}
+		gate.set_value();
+		hold.get();
+		return result;
+	};
+
+	run("a failing write is rolled back alone", [&] {
+		sqlite::async_connection db([] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE t (x INTEGER PRIMARY KEY)");
+			return c;
+		});
+		auto w = batched(db, {"INSERT INTO t VALUES (1)", "INSERT INTO t VALUES (1)", "INSERT INTO t VALUES (2)"});
+		CHECK(error_code(w[0]) == SQLITE_OK);
+		CHECK(error_code(w[1]) == SQLITE_CONSTRAINT);
+		CHECK(error_code(w[2]) == SQLITE_OK);
+		CHECK(db.batches_committed() == 1 && db.writes_committed() == 2);
+		CHECK(db.read([](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t"); }).get() == 2);
+	});
+
+	run("a write that rolls back the transaction", [&] {
+		sqlite::async_connection db([] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE t (x INTEGER UNIQUE ON CONFLICT ROLLBACK)");
+			return c;
+		});
+		auto w = batched(db, {"INSERT INTO t VALUES (1)", "INSERT INTO t VALUES (2)", "INSERT INTO t VALUES (1)",
+				      "INSERT INTO t VALUES (3)", "INSERT INTO t VALUES (4)"});
+		CHECK(error_code(w[0]) == SQLITE_ABORT);
+		CHECK(error_code(w[1]) == SQLITE_ABORT);
+		CHECK(error_code(w[2]) == SQLITE_CONSTRAINT);
+		CHECK(error_code(w[3]) == SQLITE_OK);
+		CHECK(error_code(w[4]) == SQLITE_OK);
+		CHECK(db.batches_committed() == 1 && db.writes_committed() == 2);
+		CHECK(db.read([](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t WHERE x IN (3, 4)"); }).get() == 2);
+		CHECK(db.read([](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t"); }).get() == 2);
+	});
+
+	run("no lost wakeups", [] {
+		sqlite::async_connection db([] { return sqlite::connection::create_memory(); });
+		std::vector<std::thread> threads;
+		std::atomic<int> done{0};
+		for (int i = 0; i < 4; ++i) {
+			threads.emplace_back([&] {
+				for (int j = 0; j < 20000; ++j) {
+					auto f = db.read([](sqlite::connection&) { return 1; });
+					if (f.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+						return; // the worker slept through a queued task
+					}
+					done += f.get();
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		CHECK(done == 80000);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
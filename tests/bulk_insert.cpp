@@ -0,0 +1,80 @@
+#include <string>
+#include "check.hpp"
+#include "../bulk_insert.hpp"
+
+namespace {
+
+int count(sqlite::connection& c, const std::string& table) {
+	auto s = sqlite::statement::create(c, "SELECT count(*) FROM " + table);
+	s.step();
+	return s.get_int(0);
+}
+
+} /* namespace */
+
+int main() {
+	run("batches", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER, name TEXT)");
+		for (const std::size_t rows_per_statement : {1, 7}) {
+			c.execute("DELETE FROM t");
+			sqlite::bulk_options options;
+			options.batch_size = 10;
+			options.rows_per_statement = rows_per_statement;
+			sqlite::bulk_inserter<int64_t, std::string> insert(c, "t", {"id", "name"}, options);
+			for (int i = 0; i < 95; ++i) {
+				insert.insert(i, std::to_string(i));
+			}
+			insert.flush();
+			CHECK(insert.rows_inserted() == 95);
+			CHECK(count(c, "t") == 95);
+			CHECK(sqlite3_get_autocommit(c.handle.get()) != 0);
+		}
+	});
+
+	run("names are quoted", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE \"order\" (\"first name\" TEXT, \"a\"\"b\" INTEGER)");
+		sqlite::bulk_inserter<std::string, int> insert(c, "order", {"first name", "a\"b"});
+		insert.insert(std::string("x"), 1);
+		insert.flush();
+		CHECK(count(c, "\"order\"") == 1);
+		CHECK(throws_sql_error([&] { sqlite::bulk_inserter<int> bad(c, "t; DROP TABLE x", {"c"}); }, SQLITE_ERROR));
+	});
+
+	run("inside the caller's transaction", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER)");
+		c.execute("BEGIN");
+		{
+			sqlite::bulk_options options;
+			options.batch_size = 2;
+			sqlite::bulk_inserter<int> insert(c, "t", {"id"}, options);
+			for (int i = 0; i < 5; ++i) {
+				insert.insert(i);
+			}
+			insert.flush();
+			CHECK(insert.batches_committed() == 0);
+		}
+		CHECK(sqlite3_get_autocommit(c.handle.get()) == 0);
+		c.execute("ROLLBACK");
+		CHECK(count(c, "t") == 0);
+	});
+
+	run("no flush, no commit", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER)");
+		{
+			sqlite::bulk_options options;
+			options.batch_size = 4;
+			sqlite::bulk_inserter<int> insert(c, "t", {"id"}, options);
+			for (int i = 0; i < 10; ++i) {
+				insert.insert(i);
+			}
+		}
+		CHECK(count(c, "t") == 8);
+		CHECK(sqlite3_get_autocommit(c.handle.get()) != 0);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
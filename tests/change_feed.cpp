@@ -0,0 +1,142 @@
+#include <csignal>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "check.hpp"
+#include "../change_feed.hpp"
+
+int main() {
+	run("one batch per commit", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		std::vector<std::size_t> sizes;
+		std::vector<std::string> tables;
+		feed.subscribe([&](const sqlite::change_batch& b) {
+			sizes.push_back(b.size);
+			for (auto t : b.tables) {
+				tables.push_back(*t);
+			}
+		});
+		c.execute("INSERT INTO t VALUES (1)");
+		c.execute("BEGIN");
+		c.execute("INSERT INTO t VALUES (2)");
+		c.execute("UPDATE t SET x = 3 WHERE x = 2");
+		c.execute("COMMIT");
+		c.execute("SELECT * FROM t");
+		CHECK(sizes == std::vector<std::size_t>({1, 2}));
+		CHECK(tables == std::vector<std::string>({"t", "t"}));
+		CHECK(feed.stats().commits == 2);
+		CHECK(feed.stats().events == 3);
+	});
+
+	run("rollback discards", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		int batches = 0;
+		feed.subscribe([&](const sqlite::change_batch&) { ++batches; });
+		c.execute("BEGIN");
+		c.execute("INSERT INTO t VALUES (1)");
+		c.execute("ROLLBACK");
+		c.execute("INSERT INTO t VALUES (2)");
+		// a read-only transaction after a delivered one is no failed commit
+		c.execute("BEGIN");
+		c.execute("SELECT * FROM t");
+		c.execute("ROLLBACK");
+		CHECK(batches == 1);
+		CHECK(feed.stats().rollbacks == 1);
+		CHECK(feed.stats().failed_commits == 0);
+	});
+
+	run("overflow keeps the tables", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c, 2);
+		bool overflowed = false;
+		std::size_t tables = 0;
+		feed.subscribe([&](const sqlite::change_batch& b) {
+			overflowed = b.overflowed;
+			tables = b.tables.size();
+		});
+		c.execute("INSERT INTO t VALUES (1), (2), (3)");
+		CHECK(overflowed);
+		CHECK(tables == 1);
+		CHECK(feed.stats().overflows == 1);
+	});
+
+	run("subscribe and unsubscribe from a subscriber", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		int first = 0;
+		std::vector<int> added(20, 0);
+		std::size_t self = 0;
+		self = feed.subscribe([&](const sqlite::change_batch&) {
+			++first;
+			// enough new subscribers to reallocate the vector under the loop
+			for (auto& n : added) {
+				feed.subscribe([&n](const sqlite::change_batch&) { ++n; });
+			}
+			feed.unsubscribe(self);
+		});
+		c.execute("INSERT INTO t VALUES (1)");
+		CHECK(first == 1);
+		CHECK(added[0] == 0);
+		c.execute("INSERT INTO t VALUES (2)");
+		CHECK(first == 1);
+		CHECK(added[0] == 1 && added[19] == 1);
+	});
+
+	run("subscriber errors are counted", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		int second = 0;
+		feed.subscribe([](const sqlite::change_batch&) { throw std::runtime_error("subscriber"); });
+		feed.subscribe([&](const sqlite::change_batch&) { ++second; });
+		c.execute("INSERT INTO t VALUES (1)");
+		CHECK(second == 1);
+		CHECK(feed.stats().subscriber_errors == 1);
+	});
+
+	run("a commit that fails after delivery", [] {
+		temp_database file("change_feed");
+		auto c = sqlite::connection::create(file.c_str());
+		c.execute("CREATE TABLE t (x BLOB)");
+		c.execute("INSERT INTO t VALUES (zeroblob(65536))");
+		sqlite::change_feed feed(c);
+		int batches = 0;
+		feed.subscribe([&](const sqlite::change_batch&) { ++batches; });
+
+		// the commit writes past the file size limit; the hook has run by then
+		rlimit saved;
+		getrlimit(RLIMIT_FSIZE, &saved);
+		const auto handler = std::signal(SIGXFSZ, SIG_IGN);
+		rlimit limit = saved;
+		limit.rlim_cur = 128 << 10;
+		setrlimit(RLIMIT_FSIZE, &limit);
+		bool failed = false;
+		try {
+			c.execute("INSERT INTO t VALUES (zeroblob(262144))");
+		} catch (const sqlite::sql_error&) {
+			failed = true;
+		}
+		setrlimit(RLIMIT_FSIZE, &saved);
+		std::signal(SIGXFSZ, handler);
+
+		CHECK(failed);
+		CHECK(batches == 1);
+		CHECK(feed.stats().failed_commits == 1);
+		CHECK(feed.stats().rollbacks == 1);
+		auto rows = sqlite::statement::create(c, "SELECT count(*) FROM t");
+		rows.step();
+		CHECK(rows.get_int(0) == 1);
+
+		c.execute("INSERT INTO t VALUES (1)");
+		CHECK(batches == 2);
+		CHECK(feed.stats().failed_commits == 1);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __CHECK_HPP__
+#define __CHECK_HPP__
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "../sqlite.hpp"
+
+/*
+ * Just enough for the tests: CHECK() reports a failed condition and goes
+ * on, run() catches what a test throws, and main returns
+ * check_failures() so that ctest sees it.
+ */
+inline int& check_failures() {
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition)                                                                                              \
+	do {                                                                                                          \
+		if (!(condition)) {                                                                                   \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl;    \
+			++check_failures();                                                                           \
+		}                                                                                                     \
+	} while (false)
+
+template<typename F>
+void run(const char* name, F test) {
+	try {
+		test();
+	} catch (sqlite::sql_error const& e) {
+		std::cerr << name << ": error(" << e.code << "): " << e.what() << std::endl;
+		++check_failures();
+	} catch (std::exception const& e) {
+		std::cerr << name << ": " << e.what() << std::endl;
+		++check_failures();
+	}
+}
+
+// true when f() throws an sql_error with code
+template<typename F>
+bool throws_sql_error(F f, int code) {
+	try {
+		f();
+	} catch (sqlite::sql_error const& e) {
+		return e.code == code;
+	}
+	return false;
+}
+
+// a database file under $TMPDIR, removed with its journals before and after the test
+struct temp_database {
+	std::string path;
+
+	explicit temp_database(const std::string& name) {
+		const char* dir = std::getenv("TMPDIR");
+		path = std::string(dir != nullptr ? dir : "/tmp") + "/sqlitepp11-" + std::to_string(getpid()) + "-" + name + ".db";
+		remove();
+	}
+
+	temp_database(const temp_database&) = delete;
+	temp_database& operator=(const temp_database&) = delete;
+
+	~temp_database() { remove(); }
+
+	inline const char* c_str() const noexcept { return path.c_str(); }
+
+	private:
+	void remove() const {
+		for (const char* suffix : {"", "-journal", "-wal", "-shm"}) {
+			std::remove((path + suffix).c_str());
+		}
+	}
+};
+
+#endif /* __CHECK_HPP__ */
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "../connection_pool.hpp"
+
+int main() {
+	run("leases and idle", [] {
+		sqlite::connection_pool pool([] { return sqlite::connection::create_memory(); }, 2);
+		CHECK(pool.size() == 2 && pool.idle() == 2);
+		auto a = pool.acquire();
+		auto b = pool.acquire();
+		CHECK(&a.get() != &b.get());
+		CHECK(pool.idle() == 0);
+		auto c = std::move(a);
+		c.release();
+		CHECK(pool.idle() == 1);
+		b.release();
+		CHECK(pool.idle() == 2);
+	});
+
+	run("a thread gets back the connection it used last", [] {
+		sqlite::connection_pool pool([] { return sqlite::connection::create_memory(); }, 3);
+		auto a = pool.acquire();
+		auto b = pool.acquire();
+		auto mine = &a.get();
+		a.release();
+		b.release();
+		// b was returned last, so another thread takes it
+		std::thread([&] { auto other = pool.acquire(); }).join();
+		auto again = pool.acquire();
+		CHECK(&again.get() == mine);
+	});
+
+	run("timeout and a full wait queue", [] {
+		sqlite::connection_pool pool([] { return sqlite::connection::create_memory(); }, 1, 1);
+		auto a = pool.acquire();
+		CHECK(throws_sql_error([&] { pool.acquire(std::chrono::milliseconds(10)); }, SQLITE_BUSY));
+		std::atomic<bool> waiting{false};
+		std::thread waiter([&] {
+			waiting = true;
+			auto b = pool.acquire(std::chrono::seconds(10));
+		});
+		while (!waiting) {
+			std::this_thread::yield();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		// the one queue slot is taken by waiter
+		CHECK(throws_sql_error([&] { pool.acquire(std::chrono::seconds(10)); }, SQLITE_BUSY));
+		a.release();
+		waiter.join();
+		CHECK(pool.idle() == 1);
+	});
+
+	run("one thread per connection at a time", [] {
+		temp_database db("pool");
+		sqlite::connection_options options;
+		options.journal = sqlite::JOURNAL_WAL;
+		options.busy_timeout = 10000;
+		sqlite::connection::create(db.c_str(), options).execute("CREATE TABLE t (x INTEGER)");
+		sqlite::connection_pool pool([&] { return sqlite::connection::create(db.c_str(), options); }, 3);
+		std::vector<sqlite::connection*> connections;
+		pool.for_each([&](sqlite::connection& c) { connections.push_back(&c); });
+		std::atomic<int> in_use[3];
+		for (auto& u : in_use) {
+			u = 0;
+		}
+		std::atomic<int> overlaps{0};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 8; ++i) {
+			threads.emplace_back([&, i] {
+				for (int j = 0; j < 50; ++j) {
+					auto lease = pool.acquire();
+					const auto slot = std::find(connections.begin(), connections.end(), &lease.get()) - connections.begin();
+					if (in_use[slot]++ != 0) {
+						++overlaps;
+					}
+					auto insert = lease->prepare_cached("INSERT INTO t VALUES (?)");
+					insert.bind(1, i * 100 + j).step();
+					--in_use[slot];
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		CHECK(overlaps == 0);
+		CHECK(pool.idle() == 3);
+		auto lease = pool.acquire();
+		auto count = sqlite::statement::create(*lease, "SELECT count(*) FROM t");
+		CHECK(count.step().has_data() && count.get_int(0) == 400);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
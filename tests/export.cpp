@@ -0,0 +1,88 @@
+#include <cstring>
+#include <string>
+#include <utility>
+#include "check.hpp"
+#include "../export.hpp"
+
+int main() {
+	run("csv and json lines", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (i INTEGER, r REAL, s TEXT, b BLOB)");
+		c.execute("INSERT INTO t VALUES (-9223372036854775808, 1.5, 'a,\"b\"', x'00ff'), (42, NULL, 'line\nbreak', NULL)");
+		std::string csv;
+		{
+			auto out = sqlite::output_buffer::to_string(csv, 256);
+			auto select = sqlite::statement::create(c, "SELECT i, r, s FROM t");
+			CHECK(sqlite::write_csv(select, out) == 2);
+		}
+		CHECK(csv == "i,r,s\r\n-9223372036854775808,1.5,\"a,\"\"b\"\"\"\r\n42,,\"line\nbreak\"\r\n");
+		std::string json;
+		{
+			auto out = sqlite::output_buffer::to_string(json, 256);
+			auto select = sqlite::statement::create(c, "SELECT i, r, s, b FROM t");
+			CHECK(sqlite::write_jsonl(select, out) == 2);
+			out.flush();
+			CHECK(out.bytes_written() == json.size());
+		}
+		CHECK(json == "{\"i\":-9223372036854775808,\"r\":1.5,\"s\":\"a,\\\"b\\\"\",\"b\":\"AP8=\"}\n"
+			      "{\"i\":42,\"r\":null,\"s\":\"line\\nbreak\",\"b\":null}\n");
+	});
+
+	run("a moved-from buffer writes nothing", [] {
+		std::string out;
+		int calls = 0;
+		{
+			sqlite::output_buffer a([&](const char* data, std::size_t size) { ++calls; out.append(data, size); }, 256);
+			a.append("abc", 3);
+			sqlite::output_buffer b(std::move(a));
+			b.append("def", 3);
+		}
+		CHECK(out == "abcdef");
+		CHECK(calls == 1);
+	});
+
+	run("arrow batches keep their schema", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER, v)");
+		c.execute("INSERT INTO t VALUES (1, 10), (2, 20), (3, 'thirty'), (4, NULL), (5, 5.5)");
+		auto select = sqlite::statement::create(c, "SELECT id, v FROM t ORDER BY id");
+		sqlite::arrow_reader reader(select, 2);
+		ArrowArray batch;
+		ArrowSchema schema;
+		int batches = 0;
+		int64_t sum = 0;
+		while (reader.next(&batch, &schema)) {
+			++batches;
+			CHECK(std::strcmp(schema.format, "+s") == 0 && schema.n_children == 2);
+			CHECK(std::strcmp(schema.children[0]->format, "l") == 0);
+			CHECK(std::strcmp(schema.children[1]->format, "l") == 0); // from the first row, for every batch
+			CHECK(std::strcmp(schema.children[1]->name, "v") == 0);
+			const auto v = batch.children[1];
+			const auto values = static_cast<const int64_t*>(v->buffers[1]);
+			for (int64_t i = 0; i < v->length; ++i) {
+				sum += values[i];
+			}
+			if (batches == 2) {
+				CHECK(v->null_count == 1);
+			}
+			// move a child out and release it apart from the parent, as importers do
+			ArrowSchema field = *schema.children[1];
+			schema.children[1]->release = nullptr;
+			ArrowArray column = *batch.children[1];
+			batch.children[1]->release = nullptr;
+			schema.release(&schema);
+			batch.release(&batch);
+			CHECK(std::strcmp(field.name, "v") == 0);
+			CHECK(static_cast<const int64_t*>(column.buffers[1])[0] == values[0]);
+			field.release(&field);
+			column.release(&column);
+			CHECK(field.release == nullptr && column.release == nullptr);
+		}
+		CHECK(batches == 3);
+		CHECK(sum == 10 + 20 + 0 + 5);
+		CHECK(reader.rows() == 5);
+		CHECK(!reader.next(&batch, &schema));
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <string>
+#include "check.hpp"
+#include "../ingest.hpp"
+
+namespace {
+
+int count(sqlite::connection& c, const std::string& sql) {
+	auto s = sqlite::statement::create(c, sql);
+	s.step();
+	return s.get_int(0);
+}
+
+sqlite::ingest_result load(sqlite::connection& c, const std::string& csv, const std::string& table, bool pipelined,
+			   bool header = true) {
+	sqlite::ingest_options options;
+	options.pipelined = pipelined;
+	options.header = header;
+	options.chunk_rows = 2;
+	options.batch_size = 3;
+	return sqlite::ingest_csv(c, csv.data(), csv.size(), table, {}, options);
+}
+
+} /* namespace */
+
+int main() {
+	for (const bool pipelined : {false, true}) {
+		run("fields", [=] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE t (a INTEGER, b TEXT)");
+			const auto r = load(c, "a,b\r\n1,x\n2,\"y,\"\"z\"\"\"\n3,\"multi\nline\"\n4,\n5,w", "t", pipelined);
+			CHECK(r.rows == 5);
+			CHECK(r.batches == 2);
+			CHECK(count(c, "SELECT count(*) FROM t WHERE b = 'y,\"z\"'") == 1);
+			CHECK(count(c, "SELECT count(*) FROM t WHERE b = 'multi' || char(10) || 'line'") == 1);
+			CHECK(count(c, "SELECT sum(a) FROM t") == 15);
+			CHECK(count(c, "SELECT count(*) FROM t WHERE b = ''") == 1);
+		});
+
+		run("header names are quoted", [=] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE \"my table\" (\"first name\" TEXT, \"order\" INTEGER, \"a\"\"b\" TEXT)");
+			const auto r = load(c, "first name,order,\"a\"\"b\"\nann,1,x\n", "my table", pipelined);
+			CHECK(r.rows == 1);
+			CHECK(count(c, "SELECT \"order\" FROM \"my table\" WHERE \"first name\" = 'ann' AND \"a\"\"b\" = 'x'") == 1);
+			c.execute("CREATE TABLE t (a TEXT)");
+			CHECK(throws_sql_error([&] { load(c, "a) VALUES (1); DROP TABLE t; --\n1\n", "t", pipelined); }, SQLITE_ERROR));
+			CHECK(count(c, "SELECT count(*) FROM sqlite_master WHERE name = 't'") == 1);
+		});
+
+		run("blank lines are empty rows", [=] {
+			auto c = sqlite::connection::create_memory();
+			c.execute("CREATE TABLE t (c1 TEXT)");
+			const auto r = load(c, "c1\na\n\nb\r\n\r\nc\n", "t", pipelined);
+			CHECK(r.rows == 5);
+			CHECK(count(c, "SELECT count(*) FROM t WHERE c1 = ''") == 2);
+			c.execute("DELETE FROM t");
+			CHECK(load(c, "a\n\n", "t", pipelined, false).rows == 1);
+			CHECK(load(c, "", "t", pipelined, false).rows == 0);
+		});
+	}
+
+	run("a caller's transaction", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (c1 INTEGER, c2 INTEGER)");
+		c.execute("BEGIN");
+		const auto r = load(c, "1,2\n3,4\n5,6\n7,8\n", "t", false, false);
+		CHECK(r.rows == 4 && r.batches == 0);
+		c.execute("ROLLBACK");
+		CHECK(count(c, "SELECT count(*) FROM t") == 0);
+	});
+
+	run("errors name the line", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (a, b)");
+		try {
+			load(c, "a,b\n1,2\n3\n", "t", true);
+			CHECK(false);
+		} catch (const sqlite::sql_error& e) {
+			CHECK(e.code == SQLITE_MISMATCH);
+			CHECK(std::string(e.what()).find("line 3") != std::string::npos);
+		}
+	});
+
+	run("columns", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE \"t t\" (\"x y\" INTEGER, d REAL, s TEXT)");
+		const int64_t xs[] = {1, 2, 3};
+		const double ds[] = {0.5, 1.5, 2.5};
+		const char data[] = "abcdef";
+		const int32_t offsets[] = {0, 1, 3, 6};
+		const uint8_t valid[] = {1, 0, 1};
+		const auto r = sqlite::ingest_columns(c, "t t", {"x y", "d", "s"},
+						      {sqlite::column_view::int64s(xs), sqlite::column_view::doubles(ds, valid),
+						       sqlite::column_view::texts(data, offsets)},
+						      3);
+		CHECK(r.rows == 3);
+		CHECK(count(c, "SELECT count(*) FROM \"t t\" WHERE d IS NULL AND s = 'bc'") == 1);
+		CHECK(count(c, "SELECT sum(\"x y\") FROM \"t t\" WHERE s = 'def'") == 3);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "../result_cache.hpp"
+#include "../vtab.hpp"
+
+namespace {
+
+struct row {
+	int64_t id;
+};
+
+int64_t first(const std::shared_ptr<const sqlite::cached_result>& r) { return r->get_int64(0, 0); }
+
+} /* namespace */
+
+int main() {
+	run("hits and misses", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT)");
+		c.execute("INSERT INTO t VALUES (1, 'a'), (2, 'b')");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		auto a = cache.query("SELECT name FROM t WHERE id = ?", 1);
+		auto b = cache.query("SELECT name FROM t WHERE id = ?", 1);
+		auto other = cache.query("SELECT name FROM t WHERE id = ?", 2);
+		CHECK(a == b);
+		CHECK(a->rows() == 1 && a->get_text(0, 0).str() == "a");
+		CHECK(other->get_text(0, 0).str() == "b");
+		CHECK(cache.stats().hits == 1);
+		CHECK(cache.stats().misses == 2);
+		CHECK(cache.size() == 2);
+		CHECK(throws_sql_error([&] { cache.query("DELETE FROM t"); }, SQLITE_MISUSE));
+	});
+
+	run("writes invalidate", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		c.execute("CREATE TABLE u (x INTEGER)");
+		c.execute("INSERT INTO t VALUES (1)");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		const std::string sum = "SELECT sum(x) FROM t";
+		const std::string rows = "SELECT count(*) FROM t"; // reads no column
+		CHECK(first(cache.query(sum)) == 1);
+		CHECK(first(cache.query(rows)) == 1);
+		c.execute("INSERT INTO u VALUES (5)");
+		CHECK(first(cache.query(sum)) == 1);
+		CHECK(cache.stats().hits == 1);
+		c.execute("INSERT INTO t VALUES (2)");
+		CHECK(first(cache.query(sum)) == 3);
+		CHECK(first(cache.query(rows)) == 2);
+		CHECK(cache.stats().invalidated == 2);
+		c.execute("UPDATE t SET x = 10 WHERE x = 1");
+		CHECK(first(cache.query(sum)) == 12);
+		// no truncate optimization: every row goes through the update hook
+		c.execute("DELETE FROM t");
+		CHECK(first(cache.query(rows)) == 0);
+	});
+
+	run("inside a transaction, queries bypass the cache", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		CHECK(first(cache.query("SELECT count(*) FROM t")) == 0);
+		{
+			sqlite::transaction tx(c);
+			c.execute("INSERT INTO t VALUES (1)");
+			CHECK(first(cache.query("SELECT count(*) FROM t")) == 1);
+		}
+		CHECK(cache.stats().bypassed == 1);
+		CHECK(first(cache.query("SELECT count(*) FROM t")) == 0);
+		CHECK(cache.stats().hits == 1);
+	});
+
+	run("temp and attached tables", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("ATTACH DATABASE ':memory:' AS other");
+		c.execute("CREATE TEMP TABLE t (x INTEGER)");
+		c.execute("CREATE TABLE other.u (x INTEGER)");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		CHECK(first(cache.query("SELECT count(*) FROM temp.t")) == 0);
+		CHECK(first(cache.query("SELECT count(*) FROM other.u")) == 0);
+		c.execute("INSERT INTO t VALUES (1)");
+		c.execute("INSERT INTO u VALUES (1)");
+		CHECK(first(cache.query("SELECT count(*) FROM temp.t")) == 1);
+		CHECK(first(cache.query("SELECT count(*) FROM other.u")) == 1);
+	});
+
+	run("DROP TABLE still works", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		c.execute("INSERT INTO t VALUES (1)");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		c.execute("DROP TABLE t");
+		CHECK(throws_sql_error([&] { c.execute("SELECT * FROM t"); }, SQLITE_ERROR));
+	});
+
+	run("WITHOUT ROWID and virtual tables are not cached", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE w (k TEXT PRIMARY KEY, v INT) without  rowid");
+		c.execute("INSERT INTO w VALUES ('a', 1)");
+		c.execute("CREATE TABLE t (x INTEGER)");
+		std::vector<row> rows = {{1}};
+		auto& s = sqlite::create_container_table(c, "s", rows, sqlite::vtab_columns<row>().column("id", &row::id));
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		CHECK(first(cache.query("SELECT v FROM w WHERE k = ?", "a")) == 1);
+		c.execute("UPDATE w SET v = 2");
+		CHECK(first(cache.query("SELECT v FROM w WHERE k = ?", "a")) == 2);
+		CHECK(first(cache.query("SELECT count(*) FROM w")) == 1);
+		c.execute("INSERT INTO w VALUES ('b', 3)");
+		CHECK(first(cache.query("SELECT count(*) FROM w")) == 2);
+		// a join with a plain table is no more cacheable
+		CHECK(first(cache.query("SELECT count(*) FROM t, w")) == 0);
+		CHECK(cache.query("SELECT id FROM s")->rows() == 1);
+		rows.push_back(row{2});
+		s.rebuild();
+		CHECK(cache.query("SELECT id FROM s")->rows() == 2);
+		CHECK(cache.size() == 0);
+		CHECK(cache.stats().hits == 0);
+		CHECK(cache.stats().bypassed == 7);
+	});
+
+	run("budget", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::change_feed feed(c);
+		sqlite::result_cache cache(c, feed);
+		for (int i = 0; i < 10; ++i) {
+			cache.query("SELECT ? FROM t", i);
+		}
+		cache.set_budget(cache.memory() / 2);
+		CHECK(cache.memory() <= cache.budget());
+		CHECK(cache.stats().evictions > 0);
+		CHECK(cache.size() < 10);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
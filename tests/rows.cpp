@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "check.hpp"
+#include "../rows.hpp"
+
+int main() {
+	run("row range", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		c.execute("INSERT INTO t VALUES (1), (2), (3)");
+		auto select = sqlite::statement::create(c, "SELECT x FROM t ORDER BY x");
+		int sum = 0;
+		int n = 0;
+		for (auto& row : sqlite::rows(select)) {
+			sum += row.get_int(0);
+			++n;
+		}
+		CHECK(n == 3 && sum == 6);
+	});
+
+	run("batches are columns", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (id INTEGER, flag INTEGER, name TEXT)");
+		for (int i = 0; i < 10; ++i) {
+			c.execute("INSERT INTO t VALUES (" + std::to_string(i) + ", " + std::to_string(i % 2) + ", 'n" + std::to_string(i) + "')");
+		}
+		auto select = sqlite::statement::create(c, "SELECT id, flag, name FROM t ORDER BY id");
+		sqlite::batch_reader<int64_t, bool, std::string> reader(select);
+		static_assert(std::is_same<std::decay<decltype(reader.batch().column<1>())>::type, std::vector<uint8_t>>::value,
+			      "bool columns are contiguous bytes");
+		std::size_t sizes[4] = {};
+		int batches = 0;
+		int64_t ids = 0;
+		int flags = 0;
+		while (reader.next(4)) {
+			const auto& b = reader.batch();
+			sizes[batches++] = b.size();
+			const uint8_t* f = b.column<1>().data();
+			for (std::size_t i = 0; i < b.size(); ++i) {
+				ids += b.column<0>()[i];
+				flags += f[i];
+			}
+			CHECK(b.column<2>().front() == "n" + std::to_string(b.column<0>().front()));
+		}
+		CHECK(batches == 3 && sizes[0] == 4 && sizes[1] == 4 && sizes[2] == 2);
+		CHECK(ids == 45 && flags == 5);
+		CHECK(reader.done());
+		CHECK(!reader.next(4)); // not restarted
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "../sharded.hpp"
+
+namespace {
+
+int count(sqlite::connection& c, const std::string& sql) {
+	auto s = sqlite::statement::create(c, sql);
+	s.step();
+	return s.get_int(0);
+}
+
+// the files outlive the shards' connections
+struct shard_files {
+	std::vector<std::unique_ptr<temp_database>> files;
+
+	explicit shard_files(std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i) {
+			files.emplace_back(new temp_database("shard" + std::to_string(i)));
+		}
+	}
+
+	std::vector<std::string> paths() const {
+		std::vector<std::string> result;
+		for (const auto& f : files) {
+			result.push_back(f->path);
+		}
+		return result;
+	}
+};
+
+// names of the attached databases, without main and temp
+std::vector<std::string> attached(sqlite::connection& c) {
+	std::vector<std::string> result;
+	auto list = sqlite::statement::create(c, "PRAGMA database_list");
+	while (list.step().has_data()) {
+		if (list.get_int64(0) >= 2) {
+			result.push_back(list.get_string(1));
+		}
+	}
+	return result;
+}
+
+} /* namespace */
+
+int main() {
+	run("writes reach their key's shard", [] {
+		shard_files files(3);
+		sqlite::sharded_database<int64_t> db(files.paths());
+		db.gather([](sqlite::connection& c) { c.execute("CREATE TABLE t (k INTEGER PRIMARY KEY)"); });
+		std::vector<std::future<void>> writes;
+		std::vector<int> expected(db.size(), 0);
+		for (int64_t k = 0; k < 300; ++k) {
+			++expected[db.shard_of(k)];
+			writes.push_back(db.write(k, [k](sqlite::connection& c) { c.execute("INSERT INTO t VALUES (" + std::to_string(k) + ")"); }));
+		}
+		for (auto& w : writes) {
+			w.get();
+		}
+		const auto counts = db.gather([](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t"); });
+		CHECK(counts == expected);
+		CHECK(std::accumulate(counts.begin(), counts.end(), 0) == 300);
+		for (const auto n : counts) {
+			CHECK(n > 0);
+		}
+		CHECK(db.read(42, [](sqlite::connection& c) { return count(c, "SELECT count(*) FROM t WHERE k = 42"); }).get() == 1);
+
+		const auto keys = db.gather_rows<int64_t>("SELECT k FROM t ORDER BY k", [](sqlite::statement& s) { return s.get_int64(0); },
+							  [](int64_t a, int64_t b) { return a < b; });
+		CHECK(keys.size() == 300 && keys.front() == 0 && keys.back() == 299);
+		CHECK(std::is_sorted(keys.begin(), keys.end()));
+	});
+
+	run("void gather rethrows the first error", [] {
+		shard_files files(2);
+		sqlite::sharded_database<int64_t> db(files.paths());
+		int calls = 0;
+		std::mutex m;
+		db.gather([&](sqlite::connection&) {
+			std::lock_guard<std::mutex> lock(m);
+			++calls;
+		});
+		CHECK(calls == 2);
+		CHECK(throws_sql_error([&] { db.gather([](sqlite::connection& c) { c.execute("SELECT * FROM missing"); }); },
+				       SQLITE_ERROR));
+	});
+
+	run("attach_all", [] {
+		shard_files files(3);
+		{
+			sqlite::sharded_database<int64_t> db(files.paths());
+			db.gather([](sqlite::connection& c) {
+				c.execute("CREATE TABLE t (k INTEGER)");
+				c.execute("INSERT INTO t VALUES (1)");
+			});
+			auto c = sqlite::connection::create_memory();
+			db.attach_all(c);
+			CHECK(count(c, "SELECT count(*) FROM (" + db.union_all("t") + ")") == 3);
+		}
+
+		shard_files many(11);
+		auto paths = many.paths();
+		sqlite::sharded_database<int64_t> eleven(paths);
+		auto c = sqlite::connection::create_memory();
+		CHECK(throws_sql_error([&] { eleven.attach_all(c); }, SQLITE_RANGE));
+		CHECK(attached(c).empty());
+		c.execute("ATTACH DATABASE ':memory:' AS extra");
+		paths.pop_back();
+		sqlite::sharded_database<int64_t> ten(paths);
+		CHECK(throws_sql_error([&] { ten.attach_all(c); }, SQLITE_RANGE));
+		CHECK(attached(c) == std::vector<std::string>({"extra"}));
+	});
+
+	run("attach_all detaches on failure", [] {
+		shard_files files(3);
+		sqlite::sharded_database<int64_t> db(files.paths());
+		auto c = sqlite::connection::create_memory();
+		c.execute("ATTACH DATABASE ':memory:' AS shard1");
+		CHECK(throws_sql_error([&] { db.attach_all(c); }, SQLITE_ERROR));
+		CHECK(attached(c) == std::vector<std::string>({"shard1"}));
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
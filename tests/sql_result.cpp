@@ -0,0 +1,47 @@
+#include <cstring>
+#include <string>
+#include "check.hpp"
+
+int main() {
+	run("codes", [] {
+		auto c = sqlite::connection::create_memory();
+		CHECK(c.try_execute("CREATE TABLE t (x INTEGER PRIMARY KEY)").ok());
+		auto insert = sqlite::statement::create(c, "INSERT INTO t VALUES (1)");
+		const auto r = insert.try_step();
+		CHECK(r.done() && !r.failed() && bool(r));
+		auto select = sqlite::statement::create(c, "SELECT x FROM t");
+		CHECK(select.try_step().has_data());
+		CHECK(select.try_step().done());
+	});
+
+	run("failures are reported, not thrown", [] {
+		auto c = sqlite::connection::create_memory();
+		const auto r = c.try_execute("CREATE TABLE");
+		CHECK(r.failed() && !bool(r));
+		CHECK(r.value == SQLITE_ERROR);
+		CHECK(std::strstr(r.error().what(), "syntax error") != nullptr);
+
+		sqlite::statement s;
+		const auto p = s.prepare(c, "SELECT * FROM missing");
+		CHECK(p.failed());
+		CHECK(std::strstr(p.error().what(), "no such table") != nullptr);
+	});
+
+	run("check() and the throwing calls", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER PRIMARY KEY)");
+		c.execute("INSERT INTO t VALUES (1)");
+		CHECK(throws_sql_error([&] { c.try_execute("INSERT INTO t VALUES (1)").check(); }, SQLITE_CONSTRAINT));
+		CHECK(throws_sql_error([&] { sqlite::statement::create(c, "SELEC 1"); }, SQLITE_ERROR));
+		auto insert = sqlite::statement::create(c, "INSERT INTO t VALUES (?)");
+		CHECK(throws_sql_error([&] { insert.bind(5, 1); }, SQLITE_RANGE));
+		insert.bind(1, 1);
+		CHECK(throws_sql_error([&] { insert.step(); }, SQLITE_CONSTRAINT));
+	});
+
+	run("a result stays small", [] {
+		CHECK(sizeof(sqlite::sql_result) <= 2 * sizeof(void*));
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
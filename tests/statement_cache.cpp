@@ -0,0 +1,62 @@
+#include <utility>
+#include "check.hpp"
+
+int main() {
+	run("lru", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		c.cache().set_capacity(2);
+		c.cache().reset_counters();
+		{ auto a = c.prepare_cached("SELECT 1"); }
+		{ auto a = c.prepare_cached("SELECT 2"); }
+		{ auto a = c.prepare_cached("SELECT 1"); } // hit, now most recent
+		{ auto a = c.prepare_cached("SELECT 3"); } // evicts SELECT 2
+		CHECK(c.cache().hits() == 1);
+		CHECK(c.cache().misses() == 3);
+		CHECK(c.cache().evictions() == 1);
+		CHECK(c.cache().size() == 2);
+		{ auto a = c.prepare_cached("SELECT 1"); }
+		{ auto a = c.prepare_cached("SELECT 2"); }
+		CHECK(c.cache().hits() == 2);
+		CHECK(c.cache().misses() == 4);
+	});
+
+	run("checked out twice", [] {
+		auto c = sqlite::connection::create_memory();
+		auto a = c.prepare_cached("SELECT 1");
+		auto b = c.prepare_cached("SELECT 1");
+		CHECK(a.handle.get() != b.handle.get());
+		CHECK(a.step().has_data() && b.step().has_data());
+	});
+
+	run("comes back reset and unbound", [] {
+		auto c = sqlite::connection::create_memory();
+		{
+			auto a = c.prepare_cached("SELECT ?1");
+			a.bind(1, 42);
+			CHECK(a.step().has_data());
+		}
+		auto a = c.prepare_cached("SELECT ?1");
+		CHECK(a.step().has_data());
+		CHECK(sqlite3_column_type(a.handle.get(), 0) == SQLITE_NULL);
+	});
+
+	run("moved-from connection", [] {
+		auto c = sqlite::connection::create_memory();
+		{ auto a = c.prepare_cached("SELECT 1"); }
+		auto d = std::move(c);
+		CHECK(d.cache().size() == 1);
+		CHECK(c.cache().size() == 0);
+		c.open(":memory:").check();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		{ auto a = c.prepare_cached("SELECT count(*) FROM t"); CHECK(a.step().has_data()); }
+		CHECK(c.cache().size() == 1);
+		c = std::move(d);
+		CHECK(c.cache().size() == 1);
+		CHECK(d.cache().size() == 0);
+		d = sqlite::connection::create_memory();
+		{ auto a = d.prepare_cached("SELECT 2"); CHECK(a.step().has_data()); }
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include <stdexcept>
+#include <string>
+#include "check.hpp"
+
+namespace {
+
+int count(sqlite::connection& c) {
+	auto s = sqlite::statement::create(c, "SELECT count(*) FROM t");
+	s.step();
+	return s.get_int(0);
+}
+
+} /* namespace */
+
+int main() {
+	run("transaction", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		{
+			sqlite::transaction tx(c);
+			c.execute("INSERT INTO t VALUES (1)");
+		}
+		CHECK(count(c) == 0);
+		try {
+			sqlite::transaction tx(c, sqlite::TRANSACTION_IMMEDIATE);
+			c.execute("INSERT INTO t VALUES (1)");
+			throw std::runtime_error("unwind");
+		} catch (const std::runtime_error&) {
+		}
+		CHECK(count(c) == 0);
+		{
+			sqlite::transaction tx(c);
+			c.execute("INSERT INTO t VALUES (1)");
+			tx.commit();
+			CHECK(!tx.active());
+		}
+		CHECK(count(c) == 1);
+	});
+
+	run("savepoints nest", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		sqlite::transaction tx(c);
+		c.execute("INSERT INTO t VALUES (1)");
+		{
+			sqlite::savepoint outer(c, "outer");
+			c.execute("INSERT INTO t VALUES (2)");
+			{
+				sqlite::savepoint inner(c, "inner");
+				c.execute("INSERT INTO t VALUES (3)");
+			}
+			CHECK(count(c) == 2);
+			outer.release();
+		}
+		tx.commit();
+		CHECK(count(c) == 2);
+	});
+
+	run("savepoint names are quoted", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (x INTEGER)");
+		for (const std::string name : {"my savepoint", "release", "a\"b", "x; DELETE FROM t"}) {
+			c.execute("INSERT INTO t VALUES (1)");
+			{
+				sqlite::savepoint sp(c, name);
+				CHECK(sp.name() == name);
+				c.execute("INSERT INTO t VALUES (2)");
+				sp.rollback();
+			}
+			CHECK(count(c) == 1);
+			c.execute("DELETE FROM t");
+		}
+		CHECK(sqlite3_get_autocommit(c.handle.get()) != 0);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
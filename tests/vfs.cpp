@@ -0,0 +1,158 @@
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "check.hpp"
+#include "../vfs.hpp"
+
+namespace {
+
+// XOR with a byte that depends on the offset, so any misplaced decode shows
+struct xor_backend : sqlite::transform_backend {
+	static char key(sqlite3_int64 offset) { return static_cast<char>(0x5a ^ (offset * 31)); }
+
+	void encode(const void* in, void* out, int size, sqlite3_int64 offset) override {
+		for (int i = 0; i < size; ++i) {
+			static_cast<char*>(out)[i] = static_cast<const char*>(in)[i] ^ key(offset + i);
+		}
+	}
+
+	void decode(void* data, int size, sqlite3_int64 offset) override { encode(data, data, size, offset); }
+};
+
+// true when another process sees a lock on any byte of path
+bool locked_by_us(const std::string& path) {
+	const pid_t child = fork();
+	if (child == 0) {
+		const int fd = ::open(path.c_str(), O_RDWR);
+		struct flock lock;
+		std::memset(&lock, 0, sizeof lock);
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		const bool held = fd >= 0 && fcntl(fd, F_GETLK, &lock) == 0 && lock.l_type != F_UNLCK;
+		_exit(held ? 0 : 1);
+	}
+	int status = 0;
+	return child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int count(sqlite::connection& c, const std::string& sql) {
+	auto s = sqlite::statement::create(c, sql);
+	s.step();
+	return s.get_int(0);
+}
+
+} /* namespace */
+
+int main() {
+	run("counts per file", [] {
+		temp_database file("vfs-counts");
+		sqlite::accounting_vfs io("test-counts");
+		sqlite::connection_options options;
+		options.vfs = "test-counts";
+		{
+			auto c = sqlite::connection::create(file.c_str(), options);
+			c.execute("CREATE TABLE t (x INTEGER)");
+			c.execute("INSERT INTO t VALUES (1)");
+		}
+		bool found = false;
+		for (const auto& f : io.stats()) {
+			if (f.first.find("vfs-counts.db") != std::string::npos && f.first.find("-journal") == std::string::npos) {
+				found = true;
+				CHECK(f.second.opens == 1);
+				CHECK(f.second.writes > 0);
+				CHECK(f.second.syncs > 0);
+				CHECK(f.second.write_ns.count() == f.second.writes);
+			}
+		}
+		CHECK(found);
+		CHECK(io.stats("no such file").opens == 0);
+	});
+
+	run("read-ahead options are checked", [] {
+		sqlite::vfs_options options;
+		options.read_ahead_bytes = -1;
+		CHECK(throws_sql_error([&] { sqlite::accounting_vfs io("test-bad", options); }, SQLITE_MISUSE));
+		options.read_ahead_bytes = 1 << 20;
+		options.read_ahead_after = -1;
+		CHECK(throws_sql_error([&] { sqlite::accounting_vfs io("test-bad", options); }, SQLITE_MISUSE));
+		options.read_ahead = false;
+		sqlite::accounting_vfs io("test-bad", options);
+	});
+
+	run("transform round trip", [] {
+		temp_database file("vfs-transform");
+		sqlite::vfs_options options;
+		options.backend = std::make_shared<xor_backend>();
+		sqlite::accounting_vfs io("test-xor", options);
+		sqlite::connection_options connect;
+		connect.vfs = "test-xor";
+		{
+			auto c = sqlite::connection::create(file.c_str(), connect);
+			c.execute("CREATE TABLE t (x TEXT)");
+			c.execute("INSERT INTO t VALUES ('secret')");
+		}
+		auto c = sqlite::connection::create(file.c_str(), connect);
+		CHECK(count(c, "SELECT count(*) FROM t WHERE x = 'secret'") == 1);
+		char header[16] = {};
+		const int fd = ::open(file.c_str(), O_RDONLY);
+		CHECK(fd >= 0 && ::read(fd, header, sizeof header) == sizeof header);
+		::close(fd);
+		CHECK(std::memcmp(header, "SQLite format 3", 16) != 0);
+	});
+
+	run("a short read leaves the tail zero", [] {
+		temp_database file("vfs-short");
+		sqlite::vfs_options options;
+		options.backend = std::make_shared<xor_backend>();
+		sqlite::accounting_vfs io("test-short", options);
+		auto vfs = sqlite3_vfs_find("test-short");
+		std::unique_ptr<char[]> storage(new char[vfs->szOsFile]);
+		auto f = reinterpret_cast<sqlite3_file*>(storage.get());
+		const int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_MAIN_DB;
+		CHECK(vfs->xOpen(vfs, file.c_str(), f, flags, nullptr) == SQLITE_OK);
+		CHECK(f->pMethods->xWrite(f, "0123456789", 10, 4) == SQLITE_OK);
+		char data[20];
+		std::memset(data, 'x', sizeof data);
+		CHECK(f->pMethods->xRead(f, data, 20, 4) == SQLITE_IOERR_SHORT_READ);
+		CHECK(std::memcmp(data, "0123456789", 10) == 0);
+		CHECK(std::memcmp(data + 10, "\0\0\0\0\0\0\0\0\0\0", 10) == 0);
+		CHECK(f->pMethods->xRead(f, data, 4, 100) == SQLITE_IOERR_SHORT_READ);
+		CHECK(std::memcmp(data, "\0\0\0\0", 4) == 0);
+		f->pMethods->xClose(f);
+		CHECK(io.stats(file.path).short_reads == 2);
+	});
+
+	run("closing a reader keeps another connection's locks", [] {
+		temp_database file("vfs-locks");
+		sqlite::vfs_options options;
+		options.read_ahead_after = 0;
+		options.read_ahead_bytes = 16 << 10;
+		sqlite::accounting_vfs io("test-locks", options);
+		sqlite::connection_options connect;
+		connect.vfs = "test-locks";
+		auto writer = sqlite::connection::create(file.c_str(), connect);
+		writer.execute("CREATE TABLE t (x BLOB)");
+		writer.execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 200) "
+			       "INSERT INTO t SELECT zeroblob(2000) FROM n");
+		writer.execute("BEGIN IMMEDIATE");
+		CHECK(locked_by_us(file.path));
+		{
+			auto reader = sqlite::connection::create(file.c_str(), connect);
+			CHECK(count(reader, "SELECT count(*) FROM t WHERE length(x) = 2000") == 200);
+		}
+		bool advised = false;
+		for (const auto& f : io.stats()) {
+			advised = advised || f.second.read_aheads > 0;
+		}
+		CHECK(advised);
+		CHECK(locked_by_us(file.path));
+		writer.execute("INSERT INTO t VALUES (1)");
+		writer.execute("COMMIT");
+		CHECK(!locked_by_us(file.path));
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
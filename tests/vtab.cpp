@@ -0,0 +1,62 @@
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "../vtab.hpp"
+
+namespace {
+
+struct point {
+	int64_t id;
+	double x;
+	std::string name;
+};
+
+std::string ids(sqlite::connection& c, const std::string& sql) {
+	auto s = sqlite::statement::create(c, sql);
+	std::string result;
+	while (s.step().has_data()) {
+		result += (result.empty() ? "" : " ") + std::to_string(s.get_int(0));
+	}
+	return result;
+}
+
+} /* namespace */
+
+int main() {
+	std::vector<point> points = {{1, 0.5, "b"}, {2, 2.5, "ABC"}, {3, 1.5, "abc"}, {4, -1.0, "B"}, {5, 4.0, "a"}};
+
+	run("scans and seeks", [&] {
+		auto c = sqlite::connection::create_memory();
+		auto& t = sqlite::create_container_table(c, "points", points, sqlite::vtab_columns<point>()
+			.column("id", &point::id, true)
+			.column("x", &point::x, true)
+			.column("name", &point::name, true));
+		CHECK(t.size() == 5);
+		CHECK(ids(c, "SELECT id FROM points") == "1 2 3 4 5");
+		CHECK(ids(c, "SELECT id FROM points WHERE id = 3") == "3");
+		CHECK(ids(c, "SELECT id FROM points WHERE x > 0.5 AND x <= 2.5 ORDER BY id") == "2 3");
+		CHECK(ids(c, "SELECT id FROM points ORDER BY x DESC") == "5 2 3 1 4");
+		CHECK(ids(c, "SELECT id FROM points WHERE name = 'abc'") == "3");
+		CHECK(ids(c, "SELECT id FROM points ORDER BY name") == "2 4 5 3 1");
+	});
+
+	run("collations", [&] {
+		auto c = sqlite::connection::create_memory();
+		sqlite::create_container_table(c, "points", points, sqlite::vtab_columns<point>()
+			.column("id", &point::id)
+			.column("name", &point::name, true));
+		CHECK(ids(c, "SELECT id FROM points ORDER BY name COLLATE NOCASE, id") == "5 2 3 1 4");
+		CHECK(ids(c, "SELECT id FROM points WHERE name = 'abc' COLLATE NOCASE ORDER BY id") == "2 3");
+		CHECK(ids(c, "SELECT id FROM points WHERE name COLLATE NOCASE > 'a' ORDER BY id") == "1 2 3 4");
+	});
+
+	run("names are quoted", [&] {
+		auto c = sqlite::connection::create_memory();
+		sqlite::create_container_table(c, "my \"points\"", points, sqlite::vtab_columns<point>()
+			.column("the id", &point::id, true)
+			.column("order", &point::x));
+		CHECK(ids(c, "SELECT \"the id\" FROM \"my \"\"points\"\"\" WHERE \"order\" < 1 ORDER BY \"the id\"") == "1 4");
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <string>
+#include "check.hpp"
+
+int main() {
+	run("prepares the registry", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (a INTEGER, b INTEGER)");
+		sqlite::statement_registry queries;
+		queries.add("by_a", "SELECT b FROM t WHERE a = ?").add("count", "SELECT count(*) FROM t");
+		c.warmup(queries, false);
+		c.cache().reset_counters();
+		{ auto s = c.prepare_cached(queries.sql("by_a")); }
+		{ auto s = c.prepare_cached(queries.sql("count")); }
+		CHECK(c.cache().hits() == 2);
+		CHECK(c.cache().misses() == 0);
+	});
+
+	run("a statement that does not compile", [] {
+		auto c = sqlite::connection::create_memory();
+		sqlite::statement_registry queries;
+		queries.add("missing", "SELECT * FROM missing");
+		CHECK(throws_sql_error([&] { c.warmup(queries); }, SQLITE_ERROR));
+	});
+
+	run("leaves headroom in the cache", [] {
+		auto c = sqlite::connection::create_memory();
+		c.cache().set_capacity(2);
+		sqlite::statement_registry queries;
+		for (int i = 0; i < 4; ++i) {
+			queries.add("q" + std::to_string(i), "SELECT " + std::to_string(i));
+		}
+		c.warmup(queries, false);
+		CHECK(c.cache().capacity() >= 6);
+		{
+			sqlite::transaction tx(c);
+			tx.commit();
+		}
+		c.cache().reset_counters();
+		for (const auto& e : queries.entries()) {
+			auto s = c.prepare_cached(e.sql);
+		}
+		CHECK(c.cache().hits() == 4);
+		CHECK(c.cache().evictions() == 0);
+	});
+
+	run("warms pages, skipping what it can't", [] {
+		auto c = sqlite::connection::create_memory();
+		c.execute("CREATE TABLE t (a INTEGER, b INTEGER)");
+		c.execute("CREATE INDEX t_a ON t(a) WHERE b > 0");
+		c.execute("CREATE INDEX t_b ON t(b)");
+		c.execute("INSERT INTO t VALUES (1, 1), (2, 0)");
+		sqlite::statement_registry queries;
+		queries.add("by_b", "SELECT a FROM t WHERE b = ?").hot("t");
+		c.warmup(queries);
+		auto s = c.prepare_cached(queries.sql("by_b"));
+		s.bind(1, 1);
+		CHECK(s.step().has_data() && s.get_int(0) == 1);
+	});
+
+	return check_failures() == 0 ? 0 : 1;
+}
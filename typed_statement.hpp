@@ -0,0 +1,196 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __TYPED_STATEMENT_HPP__
+#define __TYPED_STATEMENT_HPP__
+
+#include "sqlite.hpp"
+#include <string>
+#include <tuple>
+
+namespace sqlite {
+
+/*
+ * How a C++ type is bound to a parameter and read from a column. Types
+ * without a specialization do not compile, so a typed_statement never has
+ * to look at a column type at runtime.
+ */
+template<typename T>
+struct value_traits;
+
+template<>
+struct value_traits<int32_t> {
+	static inline int bind(sqlite3_stmt* stmt, int index, int32_t value) noexcept { return sqlite3_bind_int(stmt, index, value); }
+	static inline int32_t get(sqlite3_stmt* stmt, int column) noexcept { return sqlite3_column_int(stmt, column); }
+};
+
+template<>
+struct value_traits<int64_t> {
+	static inline int bind(sqlite3_stmt* stmt, int index, int64_t value) noexcept { return sqlite3_bind_int64(stmt, index, value); }
+	static inline int64_t get(sqlite3_stmt* stmt, int column) noexcept { return sqlite3_column_int64(stmt, column); }
+};
+
+template<>
+struct value_traits<double> {
+	static inline int bind(sqlite3_stmt* stmt, int index, double value) noexcept { return sqlite3_bind_double(stmt, index, value); }
+	static inline double get(sqlite3_stmt* stmt, int column) noexcept { return sqlite3_column_double(stmt, column); }
+};
+
+template<>
+struct value_traits<bool> {
+	static inline int bind(sqlite3_stmt* stmt, int index, bool value) noexcept { return sqlite3_bind_int(stmt, index, value ? 1 : 0); }
+	static inline bool get(sqlite3_stmt* stmt, int column) noexcept { return sqlite3_column_int(stmt, column) != 0; }
+};
+
+// views are bound with SQLITE_STATIC and read without a copy
+template<>
+struct value_traits<text_view> {
+	static inline int bind(sqlite3_stmt* stmt, int index, text_view value) noexcept {
+		return sqlite3_bind_text(stmt, index, value.data, static_cast<int>(value.size), SQLITE_STATIC);
+	}
+	static inline text_view get(sqlite3_stmt* stmt, int column) noexcept {
+		const auto data = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+		if (data == nullptr) {
+			return text_view{"", 0};
+		}
+		return text_view{data, static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))};
+	}
+};
+
+template<>
+struct value_traits<blob_view> {
+	static inline int bind(sqlite3_stmt* stmt, int index, blob_view value) noexcept {
+		return sqlite3_bind_blob(stmt, index, value.data, static_cast<int>(value.size), SQLITE_STATIC);
+	}
+	static inline blob_view get(sqlite3_stmt* stmt, int column) noexcept {
+		const auto data = sqlite3_column_blob(stmt, column);
+		if (data == nullptr) {
+			return blob_view{nullptr, 0};
+		}
+		return blob_view{data, static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))};
+	}
+};
+
+template<>
+struct value_traits<std::string> {
+	static inline int bind(sqlite3_stmt* stmt, int index, const std::string& value) noexcept {
+		return sqlite3_bind_text(stmt, index, value.c_str(), static_cast<int>(value.size()), SQLITE_STATIC);
+	}
+	static inline std::string get(sqlite3_stmt* stmt, int column) {
+		return value_traits<text_view>::get(stmt, column).str();
+	}
+};
+
+template<>
+struct value_traits<const char*> {
+	static inline int bind(sqlite3_stmt* stmt, int index, const char* value) noexcept {
+		return sqlite3_bind_text(stmt, index, value, -1, SQLITE_STATIC);
+	}
+};
+
+template<>
+struct value_traits<std::nullptr_t> {
+	static inline int bind(sqlite3_stmt* stmt, int index, std::nullptr_t) noexcept { return sqlite3_bind_null(stmt, index); }
+};
+
+template<typename Params, typename Columns>
+struct typed_statement;
+
+/*
+ * A statement whose parameter and column types are fixed at compile time.
+ * bind() sets every parameter in one call and next() decodes a row straight
+ * into a tuple (or anything brace-constructible from the columns), with
+ * column 0 being the first element. Parameters and columns are counted
+ * against the prepared SQL once, in create().
+ */
+template<typename... Params, typename... Cols>
+struct typed_statement<std::tuple<Params...>, std::tuple<Cols...>> {
+
+	using row = std::tuple<Cols...>;
+
+	statement stmt;
+
+	template<typename Connection>
+	static inline typed_statement create(Connection&& c, std::string sql) {
+		typed_statement result;
+		result.stmt = statement::create(std::forward<Connection>(c), std::move(sql));
+		const auto h = result.stmt.handle.get();
+		if (sqlite3_bind_parameter_count(h) != static_cast<int>(sizeof...(Params))
+		    || (sizeof...(Cols) != 0 && sqlite3_column_count(h) != static_cast<int>(sizeof...(Cols)))) {
+			throw sql_error(SQLITE_MISUSE, "typed_statement: parameter or column count does not match the SQL");
+		}
+		return result;
+	}
+
+	// resets the statement and binds all parameters; throws on the first failure
+	typed_statement& bind(const Params&... values) {
+		const auto h = stmt.handle.get();
+		sqlite3_reset(h);
+		int rc = SQLITE_OK;
+		bind_all(h, rc, typename detail::make_indices<sizeof...(Params)>::type(), values...);
+		if (rc != SQLITE_OK) {
+			sql_result::from_cmd(rc, stmt.handle).throw_error();
+		}
+		return *this;
+	}
+
+	// false once the statement is done
+	bool next(row& out) {
+		if (!stmt.step().has_data()) {
+			return false;
+		}
+		out = read<row>(typename detail::make_indices<sizeof...(Cols)>::type());
+		return true;
+	}
+
+	template<typename T>
+	bool next_as(T& out) {
+		if (!stmt.step().has_data()) {
+			return false;
+		}
+		out = read<T>(typename detail::make_indices<sizeof...(Cols)>::type());
+		return true;
+	}
+
+	// calls f(cols...) for every remaining row and returns the row count
+	template<typename F>
+	std::size_t for_each(F&& f) {
+		std::size_t rows = 0;
+		while (stmt.step().has_data()) {
+			call(f, typename detail::make_indices<sizeof...(Cols)>::type());
+			++rows;
+		}
+		return rows;
+	}
+
+	// runs a statement that returns no rows and reports sqlite3_changes()
+	int execute(const Params&... values) {
+		bind(values...);
+		while (stmt.step().has_data()) {}
+		return sqlite3_changes(sqlite3_db_handle(stmt.handle.get()));
+	}
+
+	private:
+	template<std::size_t... I>
+	static inline void bind_all(sqlite3_stmt* h, int& rc, detail::indices<I...>, const Params&... values) noexcept {
+		const int expand[] = {0, (rc = rc != SQLITE_OK ? rc : value_traits<Params>::bind(h, static_cast<int>(I) + 1, values), 0)...};
+		(void)expand;
+		(void)h;
+	}
+
+	template<typename T, std::size_t... I>
+	inline T read(detail::indices<I...>) const {
+		return T{value_traits<Cols>::get(stmt.handle.get(), static_cast<int>(I))...};
+	}
+
+	template<typename F, std::size_t... I>
+	inline void call(F& f, detail::indices<I...>) const {
+		f(value_traits<Cols>::get(stmt.handle.get(), static_cast<int>(I))...);
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __TYPED_STATEMENT_HPP__ */
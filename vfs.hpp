@@ -0,0 +1,554 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __VFS_HPP__
+#define __VFS_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sqlite {
+
+/*
+ * Latencies in power-of-two buckets: counts[i] holds the operations that
+ * took [2^i, 2^(i+1)) nanoseconds, the last bucket everything slower.
+ */
+struct latency_histogram {
+	static constexpr int buckets = 40;
+	uint64_t counts[buckets] = {};
+
+	uint64_t count() const noexcept {
+		uint64_t n = 0;
+		for (const auto c : counts) {
+			n += c;
+		}
+		return n;
+	}
+
+	// upper bound of the bucket holding fraction p (0..1) of all operations, 0 when empty
+	uint64_t percentile(double p) const noexcept {
+		const auto total = count();
+		uint64_t seen = 0;
+		for (int i = 0; i < buckets; ++i) {
+			seen += counts[i];
+			if (total > 0 && seen >= p * total) {
+				return uint64_t(1) << (i + 1);
+			}
+		}
+		return 0;
+	}
+};
+
+struct io_stats {
+	uint64_t opens = 0;
+	uint64_t reads = 0;
+	uint64_t short_reads = 0; // reads past the end of the file
+	uint64_t writes = 0;
+	uint64_t syncs = 0;
+	uint64_t truncates = 0;
+	uint64_t fetches = 0;     // pages handed out through mmap; not timed
+	uint64_t read_bytes = 0;
+	uint64_t write_bytes = 0;
+	uint64_t read_aheads = 0; // posix_fadvise(WILLNEED) calls
+	latency_histogram read_ns;
+	latency_histogram write_ns;
+	latency_histogram sync_ns;
+};
+
+/*
+ * Where the shim's reads, writes and syncs end up. The default forwards to
+ * the wrapped VFS's file; derive to batch syncs, submit through io_uring
+ * or keep pages in a store of your own. The shim accounts for the time
+ * spent here. A backend is shared by all files of its VFS, possibly from
+ * several threads.
+ */
+struct io_backend {
+	virtual ~io_backend() {}
+
+	virtual int read(sqlite3_file* file, int /* open_flags */, void* data, int amount, sqlite3_int64 offset) {
+		return file->pMethods->xRead(file, data, amount, offset);
+	}
+
+	virtual int write(sqlite3_file* file, int /* open_flags */, const void* data, int amount, sqlite3_int64 offset) {
+		return file->pMethods->xWrite(file, data, amount, offset);
+	}
+
+	virtual int sync(sqlite3_file* file, int /* open_flags */, int flags) { return file->pMethods->xSync(file, flags); }
+};
+
+/*
+ * A backend that transforms the bytes of the main database, journals and
+ * the WAL on their way to and from disk, e.g. to encrypt them. SQLite
+ * reads and writes arbitrary subranges (a WAL frame header apart from its
+ * page, the first 100 bytes of page 1), so the transform has to work on
+ * any range given its file offset and keep its size, as a stream cipher
+ * in counter mode does. Memory-mapped I/O bypasses it: keep mmap_size 0.
+ */
+struct transform_backend : io_backend {
+
+	virtual void encode(const void* in, void* out, int size, sqlite3_int64 offset) = 0;
+	virtual void decode(void* data, int size, sqlite3_int64 offset) = 0;
+
+	int read(sqlite3_file* file, int open_flags, void* data, int amount, sqlite3_int64 offset) override {
+		const int r = io_backend::read(file, open_flags, data, amount, offset);
+		if (r == SQLITE_OK && transformed(open_flags)) {
+			decode(data, amount, offset);
+		} else if (r == SQLITE_IOERR_SHORT_READ && transformed(open_flags)) {
+			// the tail past the end of the file is zero-filled and must stay so
+			sqlite3_int64 size = 0;
+			if (file->pMethods->xFileSize(file, &size) != SQLITE_OK) {
+				return SQLITE_IOERR_READ;
+			}
+			const auto valid = std::min<sqlite3_int64>(std::max<sqlite3_int64>(size - offset, 0), amount);
+			if (valid > 0) {
+				decode(data, static_cast<int>(valid), offset);
+			}
+		}
+		return r;
+	}
+
+	int write(sqlite3_file* file, int open_flags, const void* data, int amount, sqlite3_int64 offset) override {
+		if (!transformed(open_flags)) {
+			return io_backend::write(file, open_flags, data, amount, offset);
+		}
+		// SQLite's buffer is its page cache, so encode into a copy
+		std::unique_ptr<char[]> buffer(new (std::nothrow) char[amount]);
+		if (!buffer) {
+			return SQLITE_NOMEM;
+		}
+		encode(data, buffer.get(), amount, offset);
+		return io_backend::write(file, open_flags, buffer.get(), amount, offset);
+	}
+
+	private:
+	static bool transformed(int open_flags) noexcept {
+		return (open_flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_WAL)) != 0;
+	}
+};
+
+struct vfs_options {
+	bool read_ahead = true;                  // posix_fadvise(WILLNEED) ahead of sequential reads of the main database, where available
+	int read_ahead_after = 4;                // back-to-back reads before the first advice, >= 0
+	int64_t read_ahead_bytes = 1 << 20;      // how far ahead, > 0
+	std::shared_ptr<io_backend> backend;     // nullptr forwards to the wrapped VFS
+};
+
+namespace detail {
+
+	struct io_counters {
+		std::atomic<uint64_t> opens{0};
+		std::atomic<uint64_t> reads{0};
+		std::atomic<uint64_t> short_reads{0};
+		std::atomic<uint64_t> writes{0};
+		std::atomic<uint64_t> syncs{0};
+		std::atomic<uint64_t> truncates{0};
+		std::atomic<uint64_t> fetches{0};
+		std::atomic<uint64_t> read_bytes{0};
+		std::atomic<uint64_t> write_bytes{0};
+		std::atomic<uint64_t> read_aheads{0};
+		std::atomic<uint64_t> read_ns[latency_histogram::buckets];
+		std::atomic<uint64_t> write_ns[latency_histogram::buckets];
+		std::atomic<uint64_t> sync_ns[latency_histogram::buckets];
+
+		io_counters() { reset(); }
+
+		static void record(std::atomic<uint64_t>* histogram, uint64_t ns) noexcept {
+			int bucket = 63 - __builtin_clzll(ns | 1);
+			bucket = bucket < latency_histogram::buckets ? bucket : latency_histogram::buckets - 1;
+			histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		static void copy(const std::atomic<uint64_t>* from, latency_histogram& to) noexcept {
+			for (int i = 0; i < latency_histogram::buckets; ++i) {
+				to.counts[i] = from[i].load(std::memory_order_relaxed);
+			}
+		}
+
+		io_stats snapshot() const noexcept {
+			io_stats s;
+			s.opens = opens.load();
+			s.reads = reads.load();
+			s.short_reads = short_reads.load();
+			s.writes = writes.load();
+			s.syncs = syncs.load();
+			s.truncates = truncates.load();
+			s.fetches = fetches.load();
+			s.read_bytes = read_bytes.load();
+			s.write_bytes = write_bytes.load();
+			s.read_aheads = read_aheads.load();
+			copy(read_ns, s.read_ns);
+			copy(write_ns, s.write_ns);
+			copy(sync_ns, s.sync_ns);
+			return s;
+		}
+
+		void reset() noexcept {
+			for (auto c : {&opens, &reads, &short_reads, &writes, &syncs, &truncates, &fetches, &read_bytes, &write_bytes,
+				       &read_aheads}) {
+				c->store(0);
+			}
+			for (int i = 0; i < latency_histogram::buckets; ++i) {
+				read_ns[i].store(0);
+				write_ns[i].store(0);
+				sync_ns[i].store(0);
+			}
+		}
+	};
+
+	inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) noexcept {
+		return static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+} /* namespace detail */
+
+/*
+ * A VFS shim over another VFS (the default one unless named) that counts
+ * every open, read, write, sync and truncate per file path, with latency
+ * histograms, and can advise the kernel to read ahead of sequential scans.
+ * Reads, writes and syncs go through vfs_options::backend when one is set.
+ *
+ *	accounting_vfs io("accounting");
+ *	connection_options options;
+ *	options.vfs = "accounting";
+ *	auto c = connection::create("app.db", options);
+ *	...
+ *	for (auto& f : io.stats()) { f.second.sync_ns.percentile(0.99); }
+ *
+ * Counters are kept by path for the lifetime of the VFS, across opens;
+ * temporary files share the path "". Reads served from memory-mapped I/O
+ * only show up as fetches. The VFS must outlive every connection using it.
+ *
+ * Read-ahead needs a descriptor, and the wrapped file's is out of reach,
+ * so the VFS opens one read-only descriptor per database file (inode) and
+ * keeps it until it is destroyed. Closing any descriptor of a file drops
+ * every POSIX lock the process holds on it, those of other connections
+ * included, so these are never closed while a connection may be open;
+ * a database deleted meanwhile keeps its disk space until then.
+ */
+struct accounting_vfs {
+
+	// registers the VFS; make_default turns it on for connections that don't name a VFS
+	explicit accounting_vfs(const std::string& name, vfs_options options = vfs_options(), const char* base = nullptr,
+				bool make_default = false)
+	: m_name(name), m_options(std::move(options)) {
+		m_base = sqlite3_vfs_find(base);
+		if (m_base == nullptr) {
+			throw sql_error(SQLITE_ERROR, std::string("no such vfs: ") + (base != nullptr ? base : "default"));
+		}
+		if (!m_options.backend) {
+			m_options.backend = std::make_shared<io_backend>();
+		}
+		if (m_options.read_ahead && (m_options.read_ahead_after < 0 || m_options.read_ahead_bytes <= 0)) {
+			throw sql_error(SQLITE_MISUSE, "vfs_options: read_ahead_after must be >= 0 and read_ahead_bytes > 0");
+		}
+		m_vfs = sqlite3_vfs();
+		m_vfs.iVersion = m_base->iVersion < 3 ? m_base->iVersion : 3;
+		m_vfs.szOsFile = static_cast<int>(file_header_size()) + m_base->szOsFile;
+		m_vfs.mxPathname = m_base->mxPathname;
+		m_vfs.zName = m_name.c_str();
+		m_vfs.pAppData = this;
+		m_vfs.xOpen = &accounting_vfs::open;
+		m_vfs.xDelete = [](sqlite3_vfs* v, const char* n, int s) { return base_of(v)->xDelete(base_of(v), n, s); };
+		m_vfs.xAccess = [](sqlite3_vfs* v, const char* n, int f, int* r) { return base_of(v)->xAccess(base_of(v), n, f, r); };
+		m_vfs.xFullPathname = [](sqlite3_vfs* v, const char* n, int size, char* out) {
+			return base_of(v)->xFullPathname(base_of(v), n, size, out);
+		};
+		m_vfs.xDlOpen = [](sqlite3_vfs* v, const char* n) { return base_of(v)->xDlOpen(base_of(v), n); };
+		m_vfs.xDlError = [](sqlite3_vfs* v, int size, char* out) { base_of(v)->xDlError(base_of(v), size, out); };
+		m_vfs.xDlSym = [](sqlite3_vfs* v, void* h, const char* s) { return base_of(v)->xDlSym(base_of(v), h, s); };
+		m_vfs.xDlClose = [](sqlite3_vfs* v, void* h) { base_of(v)->xDlClose(base_of(v), h); };
+		m_vfs.xRandomness = [](sqlite3_vfs* v, int size, char* out) { return base_of(v)->xRandomness(base_of(v), size, out); };
+		m_vfs.xSleep = [](sqlite3_vfs* v, int us) { return base_of(v)->xSleep(base_of(v), us); };
+		m_vfs.xCurrentTime = [](sqlite3_vfs* v, double* t) { return base_of(v)->xCurrentTime(base_of(v), t); };
+		m_vfs.xGetLastError = [](sqlite3_vfs* v, int size, char* out) { return base_of(v)->xGetLastError(base_of(v), size, out); };
+		if (m_vfs.iVersion >= 2) {
+			m_vfs.xCurrentTimeInt64 = [](sqlite3_vfs* v, sqlite3_int64* t) { return base_of(v)->xCurrentTimeInt64(base_of(v), t); };
+		}
+		if (m_vfs.iVersion >= 3) {
+			m_vfs.xSetSystemCall = [](sqlite3_vfs* v, const char* n, sqlite3_syscall_ptr p) {
+				return base_of(v)->xSetSystemCall(base_of(v), n, p);
+			};
+			m_vfs.xGetSystemCall = [](sqlite3_vfs* v, const char* n) { return base_of(v)->xGetSystemCall(base_of(v), n); };
+			m_vfs.xNextSystemCall = [](sqlite3_vfs* v, const char* n) { return base_of(v)->xNextSystemCall(base_of(v), n); };
+		}
+		const auto r = sqlite3_vfs_register(&m_vfs, make_default ? 1 : 0);
+		if (r != SQLITE_OK) {
+			throw sql_error(r, "registering vfs " + m_name + " failed");
+		}
+	}
+
+	accounting_vfs(const accounting_vfs&) = delete;
+	accounting_vfs& operator=(const accounting_vfs&) = delete;
+
+	~accounting_vfs() {
+		sqlite3_vfs_unregister(&m_vfs);
+		for (const auto& fd : m_advice_fds) {
+			::close(fd.second);
+		}
+	}
+
+	inline const std::string& name() const noexcept { return m_name; }
+
+	// every path seen so far
+	std::map<std::string, io_stats> stats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<std::string, io_stats> result;
+		for (const auto& f : m_files) {
+			result[f.first] = f.second->snapshot();
+		}
+		return result;
+	}
+
+	// all zero for a path that was never opened
+	io_stats stats(const std::string& path) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto it = m_files.find(path);
+		return it == m_files.end() ? io_stats() : it->second->snapshot();
+	}
+
+	void reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& f : m_files) {
+			f.second->reset();
+		}
+	}
+
+	private:
+	// sits in front of the wrapped VFS's file in the same allocation
+	struct file {
+		sqlite3_file base;
+		accounting_vfs* vfs;
+		detail::io_counters* counters;
+		int flags;
+		std::string path;
+		sqlite3_int64 next_offset = -1; // where a sequential read would continue
+		int sequential = 0;
+		sqlite3_int64 advised_until = 0;
+		int advice_fd = -1; // owned by the VFS
+
+		inline sqlite3_file* real() noexcept {
+			return reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(this) + file_header_size());
+		}
+
+		/*
+		 * Once read_ahead_after reads in a row continued where the one
+		 * before ended, asks the kernel to start on the next
+		 * read_ahead_bytes. The advice goes through the VFS's descriptor
+		 * for the file; the page cache belongs to the file, not the
+		 * descriptor.
+		 */
+		void read_ahead(sqlite3_int64 offset, int amount) noexcept {
+#ifdef POSIX_FADV_WILLNEED
+			const auto& options = vfs->m_options;
+			sequential = offset == next_offset ? sequential + 1 : 0;
+			next_offset = offset + amount;
+			if (!options.read_ahead || path.empty() || (flags & SQLITE_OPEN_MAIN_DB) == 0
+			    || sequential < options.read_ahead_after
+			    || next_offset + options.read_ahead_bytes / 2 < advised_until) {
+				return;
+			}
+			if (advice_fd < 0) {
+				advice_fd = vfs->advice_fd(path);
+				if (advice_fd < 0) {
+					path.clear(); // don't try again
+					return;
+				}
+			}
+			const auto from = std::max<sqlite3_int64>(next_offset, advised_until);
+			advised_until = next_offset + options.read_ahead_bytes;
+			::posix_fadvise(advice_fd, from, advised_until - from, POSIX_FADV_WILLNEED);
+			counters->read_aheads.fetch_add(1, std::memory_order_relaxed);
+#else
+			(void)offset;
+			(void)amount;
+#endif
+		}
+	};
+
+	std::string m_name;
+	vfs_options m_options;
+	sqlite3_vfs* m_base = nullptr;
+	sqlite3_vfs m_vfs;
+	mutable std::mutex m_mutex;
+	std::map<std::string, std::unique_ptr<detail::io_counters>> m_files;
+	std::multimap<std::pair<dev_t, ino_t>, int> m_advice_fds; // by inode, closed only by the destructor
+
+	static constexpr std::size_t file_header_size() noexcept { return (sizeof(file) + 15) & ~std::size_t(15); }
+
+	static inline sqlite3_vfs* base_of(sqlite3_vfs* v) noexcept { return static_cast<accounting_vfs*>(v->pAppData)->m_base; }
+	static inline file& self(sqlite3_file* f) noexcept { return *reinterpret_cast<file*>(f); }
+
+	detail::io_counters* counters_for(const std::string& path) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& c = m_files[path];
+		if (!c) {
+			c.reset(new detail::io_counters());
+		}
+		return c.get();
+	}
+
+	// the read-ahead descriptor of path's inode, opened on first use; -1 if it can't be
+	int advice_fd(const std::string& path) noexcept {
+		struct stat st;
+		if (::stat(path.c_str(), &st) != 0) {
+			return -1;
+		}
+		try {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const auto it = m_advice_fds.find(std::make_pair(st.st_dev, st.st_ino));
+			if (it != m_advice_fds.end()) {
+				return it->second;
+			}
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				return -1;
+			}
+			// once open it stays open; if path was replaced since stat(), file it under what it is
+			if (::fstat(fd, &st) != 0) {
+				st.st_dev = 0;
+				st.st_ino = 0;
+			}
+			m_advice_fds.emplace(std::make_pair(st.st_dev, st.st_ino), fd);
+			return fd;
+		} catch (...) {
+			return -1; // a descriptor leaked here is harmless, closing it would not be
+		}
+	}
+
+	// one table per io_methods version, so SQLite only calls what the wrapped file has
+	static const sqlite3_io_methods* methods(int version) noexcept {
+		static const sqlite3_io_methods table[] = {make_methods(1), make_methods(2), make_methods(3)};
+		return &table[(version < 1 ? 1 : version > 3 ? 3 : version) - 1];
+	}
+
+	static sqlite3_io_methods make_methods(int version) noexcept {
+		sqlite3_io_methods m = sqlite3_io_methods();
+		m.iVersion = version;
+		m.xClose = &accounting_vfs::close;
+		m.xRead = &accounting_vfs::read;
+		m.xWrite = &accounting_vfs::write;
+		m.xTruncate = [](sqlite3_file* f, sqlite3_int64 size) {
+			self(f).counters->truncates.fetch_add(1, std::memory_order_relaxed);
+			return self(f).real()->pMethods->xTruncate(self(f).real(), size);
+		};
+		m.xSync = &accounting_vfs::sync;
+		m.xFileSize = [](sqlite3_file* f, sqlite3_int64* size) { return self(f).real()->pMethods->xFileSize(self(f).real(), size); };
+		m.xLock = [](sqlite3_file* f, int lock) { return self(f).real()->pMethods->xLock(self(f).real(), lock); };
+		m.xUnlock = [](sqlite3_file* f, int lock) { return self(f).real()->pMethods->xUnlock(self(f).real(), lock); };
+		m.xCheckReservedLock = [](sqlite3_file* f, int* out) {
+			return self(f).real()->pMethods->xCheckReservedLock(self(f).real(), out);
+		};
+		m.xFileControl = [](sqlite3_file* f, int op, void* arg) {
+			return self(f).real()->pMethods->xFileControl(self(f).real(), op, arg);
+		};
+		m.xSectorSize = [](sqlite3_file* f) { return self(f).real()->pMethods->xSectorSize(self(f).real()); };
+		m.xDeviceCharacteristics = [](sqlite3_file* f) {
+			return self(f).real()->pMethods->xDeviceCharacteristics(self(f).real());
+		};
+		m.xShmMap = [](sqlite3_file* f, int page, int size, int extend, void volatile** out) {
+			return self(f).real()->pMethods->xShmMap(self(f).real(), page, size, extend, out);
+		};
+		m.xShmLock = [](sqlite3_file* f, int offset, int n, int flags) {
+			return self(f).real()->pMethods->xShmLock(self(f).real(), offset, n, flags);
+		};
+		m.xShmBarrier = [](sqlite3_file* f) { self(f).real()->pMethods->xShmBarrier(self(f).real()); };
+		m.xShmUnmap = [](sqlite3_file* f, int remove) { return self(f).real()->pMethods->xShmUnmap(self(f).real(), remove); };
+		m.xFetch = [](sqlite3_file* f, sqlite3_int64 offset, int amount, void** out) {
+			const int r = self(f).real()->pMethods->xFetch(self(f).real(), offset, amount, out);
+			if (r == SQLITE_OK && *out != nullptr) {
+				self(f).counters->fetches.fetch_add(1, std::memory_order_relaxed);
+			}
+			return r;
+		};
+		m.xUnfetch = [](sqlite3_file* f, sqlite3_int64 offset, void* p) {
+			return self(f).real()->pMethods->xUnfetch(self(f).real(), offset, p);
+		};
+		return m;
+	}
+
+	static int open(sqlite3_vfs* v, const char* name, sqlite3_file* f, int flags, int* out_flags) {
+		auto& vfs = *static_cast<accounting_vfs*>(v->pAppData);
+		file* shim;
+		try {
+			shim = new (f) file();
+			shim->vfs = &vfs;
+			shim->flags = flags;
+			shim->path = name != nullptr ? name : "";
+			shim->counters = vfs.counters_for(shim->path);
+		} catch (...) {
+			f->pMethods = nullptr;
+			return SQLITE_NOMEM;
+		}
+		const auto real = shim->real();
+		real->pMethods = nullptr;
+		const int r = vfs.m_base->xOpen(vfs.m_base, name, real, flags, out_flags);
+		if (real->pMethods == nullptr) {
+			shim->~file();
+			f->pMethods = nullptr;
+			return r;
+		}
+		// SQLite calls xClose from here on, even if the open failed
+		f->pMethods = methods(real->pMethods->iVersion);
+		shim->counters->opens.fetch_add(1, std::memory_order_relaxed);
+		return r;
+	}
+
+	static int close(sqlite3_file* f) {
+		auto& shim = self(f);
+		const int r = shim.real()->pMethods->xClose(shim.real());
+		shim.~file();
+		return r;
+	}
+
+	static int read(sqlite3_file* f, void* data, int amount, sqlite3_int64 offset) {
+		auto& shim = self(f);
+		const auto start = std::chrono::steady_clock::now();
+		const int r = shim.vfs->m_options.backend->read(shim.real(), shim.flags, data, amount, offset);
+		detail::io_counters::record(shim.counters->read_ns, detail::elapsed_ns(start));
+		shim.counters->reads.fetch_add(1, std::memory_order_relaxed);
+		shim.counters->read_bytes.fetch_add(static_cast<uint64_t>(amount), std::memory_order_relaxed);
+		shim.counters->short_reads.fetch_add(r == SQLITE_IOERR_SHORT_READ ? 1 : 0, std::memory_order_relaxed);
+		if (r == SQLITE_OK) {
+			shim.read_ahead(offset, amount);
+		}
+		return r;
+	}
+
+	static int write(sqlite3_file* f, const void* data, int amount, sqlite3_int64 offset) {
+		auto& shim = self(f);
+		const auto start = std::chrono::steady_clock::now();
+		const int r = shim.vfs->m_options.backend->write(shim.real(), shim.flags, data, amount, offset);
+		detail::io_counters::record(shim.counters->write_ns, detail::elapsed_ns(start));
+		shim.counters->writes.fetch_add(1, std::memory_order_relaxed);
+		shim.counters->write_bytes.fetch_add(static_cast<uint64_t>(amount), std::memory_order_relaxed);
+		return r;
+	}
+
+	static int sync(sqlite3_file* f, int flags) {
+		auto& shim = self(f);
+		const auto start = std::chrono::steady_clock::now();
+		const int r = shim.vfs->m_options.backend->sync(shim.real(), shim.flags, flags);
+		detail::io_counters::record(shim.counters->sync_ns, detail::elapsed_ns(start));
+		shim.counters->syncs.fetch_add(1, std::memory_order_relaxed);
+		return r;
+	}
+};
+
+} /* namespace sqlite  */
+
+#endif /* __VFS_HPP__ */
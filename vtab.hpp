@@ -0,0 +1,518 @@
+/*
+*
+*	Author: Philipp Zschoche, https://zschoche.org
+*
+*/
+#ifndef __VTAB_HPP__
+#define __VTAB_HPP__
+
+#include "sqlite.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlite {
+
+namespace detail {
+
+	// how a member type shows up in a virtual table column
+	template<typename M>
+	struct vtab_value;
+
+	template<typename M>
+	struct vtab_integer {
+		static const char* sql_type() noexcept { return "INTEGER"; }
+		static bool text() noexcept { return false; }
+		static void result(sqlite3_context* ctx, M value) noexcept { sqlite3_result_int64(ctx, static_cast<int64_t>(value)); }
+		static bool seekable(sqlite3_value* v) noexcept {
+			const int type = sqlite3_value_numeric_type(v);
+			return type == SQLITE_INTEGER || type == SQLITE_FLOAT;
+		}
+		static int compare(M value, sqlite3_value* v) noexcept {
+			if (sqlite3_value_type(v) == SQLITE_INTEGER) {
+				const auto rhs = sqlite3_value_int64(v);
+				const auto lhs = static_cast<int64_t>(value);
+				return lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+			}
+			const auto rhs = sqlite3_value_double(v);
+			const auto lhs = static_cast<double>(value);
+			return lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+		}
+	};
+
+	template<> struct vtab_value<int32_t> : vtab_integer<int32_t> {};
+	template<> struct vtab_value<int64_t> : vtab_integer<int64_t> {};
+	template<> struct vtab_value<bool> : vtab_integer<bool> {};
+
+	template<>
+	struct vtab_value<double> {
+		static const char* sql_type() noexcept { return "REAL"; }
+		static bool text() noexcept { return false; }
+		static void result(sqlite3_context* ctx, double value) noexcept { sqlite3_result_double(ctx, value); }
+		static bool seekable(sqlite3_value* v) noexcept { return vtab_integer<double>::seekable(v); }
+		static int compare(double value, sqlite3_value* v) noexcept {
+			const auto rhs = sqlite3_value_double(v);
+			return value < rhs ? -1 : value > rhs ? 1 : 0;
+		}
+	};
+
+	// compared like the BINARY collation, which is declared for the column
+	template<>
+	struct vtab_value<std::string> {
+		static const char* sql_type() noexcept { return "TEXT COLLATE BINARY"; }
+		static bool text() noexcept { return true; }
+		static void result(sqlite3_context* ctx, const std::string& value) noexcept {
+			sqlite3_result_text(ctx, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+		}
+		static bool seekable(sqlite3_value* v) noexcept { return sqlite3_value_type(v) == SQLITE_TEXT; }
+		static int compare(const std::string& value, sqlite3_value* v) noexcept {
+			const auto rhs = reinterpret_cast<const char*>(sqlite3_value_text(v));
+			const auto rhs_size = static_cast<std::size_t>(sqlite3_value_bytes(v));
+			const int r = std::memcmp(value.data(), rhs, std::min(value.size(), rhs_size));
+			if (r != 0) {
+				return r;
+			}
+			return value.size() < rhs_size ? -1 : value.size() > rhs_size ? 1 : 0;
+		}
+	};
+
+} /* namespace detail */
+
+// one column of a container_table, read from a member of the row type
+template<typename Row>
+struct vtab_column {
+	std::string name;
+	bool indexed;
+
+	vtab_column(std::string _name, bool _indexed) : name(std::move(_name)), indexed(_indexed) {}
+	virtual ~vtab_column() {}
+
+	virtual const char* sql_type() const noexcept = 0;
+	// text compares under a collation; compare() and less() must be BINARY's
+	virtual bool text() const noexcept = 0;
+	virtual void result(sqlite3_context* ctx, const Row& row) const noexcept = 0;
+	virtual bool less(const Row& a, const Row& b) const noexcept = 0;
+	// whether compare() can order rows against v, e.g. not text against numbers
+	virtual bool seekable(sqlite3_value* v) const noexcept = 0;
+	virtual int compare(const Row& row, sqlite3_value* v) const noexcept = 0;
+};
+
+template<typename Row, typename M>
+struct vtab_member_column : vtab_column<Row> {
+	using traits = detail::vtab_value<M>;
+	M Row::* member;
+
+	vtab_member_column(std::string name, M Row::* _member, bool indexed)
+	: vtab_column<Row>(std::move(name), indexed), member(_member) {}
+
+	const char* sql_type() const noexcept override { return traits::sql_type(); }
+	bool text() const noexcept override { return traits::text(); }
+	void result(sqlite3_context* ctx, const Row& row) const noexcept override { traits::result(ctx, row.*member); }
+	bool less(const Row& a, const Row& b) const noexcept override { return a.*member < b.*member; }
+	bool seekable(sqlite3_value* v) const noexcept override { return traits::seekable(v); }
+	int compare(const Row& row, sqlite3_value* v) const noexcept override { return traits::compare(row.*member, v); }
+};
+
+// describes the columns of a container_table
+template<typename Row>
+struct vtab_columns {
+	std::vector<std::shared_ptr<const vtab_column<Row>>> list;
+
+	template<typename M>
+	vtab_columns& column(std::string name, M Row::* member, bool indexed = false) {
+		list.emplace_back(new vtab_member_column<Row, M>(std::move(name), member, indexed));
+		return *this;
+	}
+};
+
+template<typename Container>
+struct container_table;
+
+namespace detail {
+
+	template<typename Container>
+	struct vtab_module {
+		using table_type = container_table<Container>;
+
+		enum {
+			PLAN_EQ = 1,
+			PLAN_LOWER = 2,
+			PLAN_LOWER_STRICT = 4,
+			PLAN_UPPER = 8,
+			PLAN_UPPER_STRICT = 16,
+			PLAN_DESC = 32
+		};
+
+		struct table : sqlite3_vtab {
+			table_type* owner;
+		};
+
+		struct cursor : sqlite3_vtab_cursor {
+			const std::size_t* ids; // nullptr scans the rows in container order
+			std::size_t first;
+			std::size_t last;
+			std::size_t current;
+			bool reverse;
+
+			inline std::size_t id() const noexcept {
+				const auto k = reverse ? last - 1 - (current - first) : current;
+				return ids != nullptr ? ids[k] : k;
+			}
+		};
+
+		static const sqlite3_module* get() noexcept {
+			static const sqlite3_module module = {
+				1,              // iVersion
+				&connect,       // xCreate
+				&connect,       // xConnect
+				&best_index,
+				&disconnect,
+				&disconnect,    // xDestroy
+				&open,
+				&close,
+				&filter,
+				&next,
+				&eof,
+				&column,
+				&rowid,
+				nullptr,        // xUpdate: read-only
+				nullptr, nullptr, nullptr, nullptr,
+				nullptr,        // xFindFunction
+				nullptr,        // xRename
+				nullptr, nullptr, nullptr
+			};
+			return &module;
+		}
+
+		static int connect(sqlite3* db, void* aux, int, const char* const*, sqlite3_vtab** out, char** error) noexcept {
+			const auto owner = static_cast<table_type*>(aux);
+			try {
+				std::string schema = "CREATE TABLE x(";
+				for (std::size_t i = 0; i < owner->m_columns.size(); ++i) {
+					const auto& c = *owner->m_columns[i];
+					schema += (i == 0 ? "" : ", ") + detail::quote_identifier(c.name) + " " + c.sql_type();
+				}
+				schema += ")";
+				const int r = sqlite3_declare_vtab(db, schema.c_str());
+				if (r != SQLITE_OK) {
+					*error = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+					return r;
+				}
+				const auto t = new table();
+				t->owner = owner;
+				*out = t;
+				return SQLITE_OK;
+			} catch (...) {
+				return SQLITE_NOMEM;
+			}
+		}
+
+		static int disconnect(sqlite3_vtab* t) noexcept {
+			delete static_cast<table*>(t);
+			return SQLITE_OK;
+		}
+
+		/*
+		 * Picks the indexed column with the cheapest usable constraint:
+		 * equality, else a range with a lower and/or upper bound. A single
+		 * ORDER BY on an indexed column is served from that index. The
+		 * constraints are not omitted, so SQLite checks every row again;
+		 * the index only has to narrow the rows down.
+		 *
+		 * The indexes are sorted like BINARY. SQLite only hands over
+		 * ORDER BY terms in the column's declared collation, which is
+		 * BINARY, but text constraints may carry any other (x = 'a'
+		 * COLLATE NOCASE), so they only seek when theirs is known to be
+		 * BINARY.
+		 */
+		static int best_index(sqlite3_vtab* vt, sqlite3_index_info* info) noexcept {
+			const auto& owner = *static_cast<table*>(vt)->owner;
+			const auto n = static_cast<double>(std::max<std::size_t>(owner.size(), 1));
+			const auto log_n = std::log2(n) + 1;
+
+			int best_column = -1;
+			int best_flags = 0;
+			int best_args[2] = {-1, -1};
+			double best_cost = n;
+			double best_rows = n;
+
+			for (std::size_t c = 0; c < owner.m_columns.size(); ++c) {
+				if (!owner.m_columns[c]->indexed) {
+					continue;
+				}
+				int eq = -1;
+				int lower = -1;
+				int upper = -1;
+				for (int i = 0; i < info->nConstraint; ++i) {
+					const auto& k = info->aConstraint[i];
+					if (!k.usable || k.iColumn != static_cast<int>(c)
+					    || (owner.m_columns[c]->text() && !binary_collation(info, i))) {
+						continue;
+					}
+					if (k.op == SQLITE_INDEX_CONSTRAINT_EQ && eq < 0) {
+						eq = i;
+					} else if ((k.op == SQLITE_INDEX_CONSTRAINT_GT || k.op == SQLITE_INDEX_CONSTRAINT_GE) && lower < 0) {
+						lower = i;
+					} else if ((k.op == SQLITE_INDEX_CONSTRAINT_LT || k.op == SQLITE_INDEX_CONSTRAINT_LE) && upper < 0) {
+						upper = i;
+					}
+				}
+				int flags = 0;
+				double rows = n;
+				int args[2] = {-1, -1};
+				if (eq >= 0) {
+					flags = PLAN_EQ;
+					rows = 1;
+					args[0] = eq;
+				} else if (lower >= 0 || upper >= 0) {
+					rows = lower >= 0 && upper >= 0 ? n / 16 : n / 4;
+					int a = 0;
+					if (lower >= 0) {
+						flags |= PLAN_LOWER;
+						flags |= info->aConstraint[lower].op == SQLITE_INDEX_CONSTRAINT_GT ? PLAN_LOWER_STRICT : 0;
+						args[a++] = lower;
+					}
+					if (upper >= 0) {
+						flags |= PLAN_UPPER;
+						flags |= info->aConstraint[upper].op == SQLITE_INDEX_CONSTRAINT_LT ? PLAN_UPPER_STRICT : 0;
+						args[a++] = upper;
+					}
+				} else {
+					continue;
+				}
+				const auto cost = log_n + rows;
+				if (cost < best_cost) {
+					best_column = static_cast<int>(c);
+					best_flags = flags;
+					best_args[0] = args[0];
+					best_args[1] = args[1];
+					best_cost = cost;
+					best_rows = rows;
+				}
+			}
+
+			if (info->nOrderBy == 1) {
+				const int c = info->aOrderBy[0].iColumn;
+				const bool sortable = c >= 0 && static_cast<std::size_t>(c) < owner.m_columns.size()
+						      && owner.m_columns[c]->indexed;
+				if (sortable && (best_column < 0 || best_column == c)) {
+					best_column = c;
+					best_flags |= info->aOrderBy[0].desc ? PLAN_DESC : 0;
+					info->orderByConsumed = 1;
+				}
+			}
+
+			for (int a = 0; a < 2; ++a) {
+				if (best_args[a] >= 0) {
+					info->aConstraintUsage[best_args[a]].argvIndex = a + 1;
+					info->aConstraintUsage[best_args[a]].omit = 0;
+				}
+			}
+			info->idxNum = ((best_column + 1) << 8) | best_flags;
+			info->estimatedCost = best_cost;
+			info->estimatedRows = static_cast<sqlite3_int64>(best_rows);
+			return SQLITE_OK;
+		}
+
+		// sqlite3_vtab_collation() came with SQLite 3.22, before that the collation is unknown
+		static bool binary_collation(sqlite3_index_info* info, int constraint) noexcept {
+#if SQLITE_VERSION_NUMBER >= 3022000
+			const char* name = sqlite3_vtab_collation(info, constraint);
+			return name == nullptr || sqlite3_stricmp(name, "BINARY") == 0;
+#else
+			(void)info;
+			(void)constraint;
+			return false;
+#endif
+		}
+
+		static int open(sqlite3_vtab*, sqlite3_vtab_cursor** out) noexcept {
+			const auto c = new (std::nothrow) cursor();
+			if (c == nullptr) {
+				return SQLITE_NOMEM;
+			}
+			*out = c;
+			return SQLITE_OK;
+		}
+
+		static int close(sqlite3_vtab_cursor* c) noexcept {
+			delete static_cast<cursor*>(c);
+			return SQLITE_OK;
+		}
+
+		static int filter(sqlite3_vtab_cursor* vc, int plan, const char*, int argc, sqlite3_value** argv) noexcept {
+			auto& c = *static_cast<cursor*>(vc);
+			const auto& owner = *static_cast<table*>(vc->pVtab)->owner;
+			const int column = (plan >> 8) - 1;
+			const int flags = plan & 0xff;
+			c.ids = column >= 0 ? owner.m_indexes[column].data() : nullptr;
+			c.first = 0;
+			c.last = owner.size();
+			c.reverse = (flags & PLAN_DESC) != 0;
+
+			int a = 0;
+			if (flags & PLAN_EQ) {
+				seek(owner, column, c, a < argc ? argv[a] : nullptr, false, true);
+				seek(owner, column, c, a < argc ? argv[a] : nullptr, true, false);
+				++a;
+			}
+			if (flags & PLAN_LOWER) {
+				seek(owner, column, c, a < argc ? argv[a] : nullptr, (flags & PLAN_LOWER_STRICT) != 0, true);
+				++a;
+			}
+			if (flags & PLAN_UPPER) {
+				seek(owner, column, c, a < argc ? argv[a] : nullptr, (flags & PLAN_UPPER_STRICT) == 0, false);
+				++a;
+			}
+			c.last = std::max(c.first, c.last);
+			c.current = c.first;
+			return SQLITE_OK;
+		}
+
+		/*
+		 * Narrows [first, last) of the column's index: a lower bound moves
+		 * first to the first row >= v (> v when past), an upper bound moves
+		 * last to the first row > v (>= v unless past). Nothing compares
+		 * with NULL; values of another kind leave the range to SQLite.
+		 */
+		static void seek(const table_type& owner, int column, cursor& c, sqlite3_value* v, bool past, bool is_lower) noexcept {
+			if (v == nullptr || sqlite3_value_type(v) == SQLITE_NULL) {
+				c.last = c.first;
+				return;
+			}
+			const auto& col = *owner.m_columns[column];
+			if (!col.seekable(v)) {
+				return;
+			}
+			const auto& rows = owner.m_rows;
+			const auto begin = c.ids + c.first;
+			const auto end = c.ids + c.last;
+			const std::size_t* it;
+			if (past) {
+				it = std::upper_bound(begin, end, v, [&](sqlite3_value* value, std::size_t id) {
+					return col.compare(*rows[id], value) > 0;
+				});
+			} else {
+				it = std::lower_bound(begin, end, v, [&](std::size_t id, sqlite3_value* value) {
+					return col.compare(*rows[id], value) < 0;
+				});
+			}
+			const auto pos = static_cast<std::size_t>(it - c.ids);
+			if (is_lower) {
+				c.first = pos;
+			} else {
+				c.last = pos;
+			}
+		}
+
+		static int next(sqlite3_vtab_cursor* c) noexcept {
+			++static_cast<cursor*>(c)->current;
+			return SQLITE_OK;
+		}
+
+		static int eof(sqlite3_vtab_cursor* vc) noexcept {
+			const auto& c = *static_cast<cursor*>(vc);
+			return c.current >= c.last ? 1 : 0;
+		}
+
+		static int column(sqlite3_vtab_cursor* vc, sqlite3_context* ctx, int i) noexcept {
+			const auto& c = *static_cast<cursor*>(vc);
+			const auto& owner = *static_cast<table*>(vc->pVtab)->owner;
+			owner.m_columns[i]->result(ctx, *owner.m_rows[c.id()]);
+			return SQLITE_OK;
+		}
+
+		static int rowid(sqlite3_vtab_cursor* vc, sqlite3_int64* out) noexcept {
+			*out = static_cast<sqlite3_int64>(static_cast<cursor*>(vc)->id());
+			return SQLITE_OK;
+		}
+
+		static void destroy(void* owner) noexcept { delete static_cast<table_type*>(owner); }
+	};
+
+} /* namespace detail */
+
+/*
+ * A read-only virtual table over a caller-owned container of structs, so
+ * SQL can join against in-memory data without copying it into a table.
+ * Indexed columns get a sorted array of row positions that serves
+ * equality and range constraints and ORDER BY on that column; the rowid
+ * is the row's position in the container. Text sorts like BINARY, so
+ * text constraints under another collation scan, and so do all text
+ * constraints with SQLite before 3.22, which cannot tell the collation.
+ *
+ *	auto& t = create_container_table(c, "points", points, vtab_columns<point>()
+ *		.column("id", &point::id, true)
+ *		.column("x", &point::x));
+ *
+ * The table is created in the temp schema. The container must outlive the
+ * connection and must not change while statements on the table run;
+ * call rebuild() after changing it.
+ */
+template<typename Container>
+struct container_table {
+	using row = typename std::decay<decltype(*std::begin(std::declval<const Container&>()))>::type;
+
+	container_table(const Container& data, vtab_columns<row> columns)
+	: m_data(data), m_columns(std::move(columns.list)) {
+		rebuild();
+	}
+
+	// re-reads the container and sorts the indexes again
+	void rebuild() {
+		m_rows.clear();
+		for (const auto& r : m_data) {
+			m_rows.push_back(&r);
+		}
+		m_indexes.assign(m_columns.size(), std::vector<std::size_t>());
+		for (std::size_t c = 0; c < m_columns.size(); ++c) {
+			if (!m_columns[c]->indexed) {
+				continue;
+			}
+			auto& index = m_indexes[c];
+			index.resize(m_rows.size());
+			for (std::size_t i = 0; i < index.size(); ++i) {
+				index[i] = i;
+			}
+			const auto& col = *m_columns[c];
+			const auto& rows = m_rows;
+			std::stable_sort(index.begin(), index.end(), [&](std::size_t a, std::size_t b) {
+				return col.less(*rows[a], *rows[b]);
+			});
+		}
+	}
+
+	inline std::size_t size() const noexcept { return m_rows.size(); }
+
+	private:
+	friend struct detail::vtab_module<Container>;
+
+	const Container& m_data;
+	std::vector<std::shared_ptr<const vtab_column<row>>> m_columns;
+	std::vector<const row*> m_rows;
+	std::vector<std::vector<std::size_t>> m_indexes;
+};
+
+/*
+ * Registers a module called name and creates temp.name over data. The
+ * returned table belongs to the connection and lives until it closes.
+ */
+template<typename Container>
+container_table<Container>& create_container_table(connection& c, const std::string& name, const Container& data,
+						   vtab_columns<typename container_table<Container>::row> columns) {
+	using module = detail::vtab_module<Container>;
+	const auto owner = new container_table<Container>(data, std::move(columns));
+	// SQLite takes ownership, and on failure has already destroyed it
+	const auto r = sqlite3_create_module_v2(c.handle.get(), name.c_str(), module::get(), owner, &module::destroy);
+	sql_result::from_cmd(r, c.handle).check();
+	c.execute("CREATE VIRTUAL TABLE temp." + detail::quote_identifier(name) + " USING " + detail::quote_identifier(name));
+	return *owner;
+}
+
+} /* namespace sqlite  */
+
+#endif /* __VTAB_HPP__ */